@@ -0,0 +1,103 @@
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <nana/gui.hpp>
+#include <nana/gui/timer.hpp>
+#include "plot2d.h"
+
+/* Times the conversion of plot values to pixels
+
+    The per point loop calls plot::X2Pixel( double ) for each value,
+    as all drawing did before the batched kernels.
+    The batched call converts an array of values
+    with the AVX2, SSE2 or scalar kernel chosen for this CPU,
+    the kernel shared by rendering, decimation and hit testing.
+*/
+
+/// best time in milliseconds of repeated runs of f
+template< class F >
+double best( F f )
+{
+    const int REPEAT = 20;
+    double ms = 1e30;
+    for( int k = 0; k < REPEAT; k++ )
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop = std::chrono::steady_clock::now();
+        ms = std::min( ms, std::chrono::duration< double, std::milli >( stop - start ).count() );
+    }
+    return ms;
+}
+
+int main()
+{
+
+    using namespace nana;
+
+    try
+    {
+        form fm;
+
+        // construct plot to be drawn on form
+        plot::plot thePlot( fm );
+
+        // plot the data to be converted, so the scale is the one used for drawing
+        const int COUNT = 1000000;
+        std::vector< double > x( COUNT );
+        for( int k = 0; k < COUNT; k++ )
+            x[ k ] = 100 * sin( k / 1000.0 );
+        plot::trace& t1 = thePlot.AddStaticTrace();
+        t1.set( x );
+        t1.color( colors::blue );
+
+        // run the benchmark once the plot has been drawn
+        timer theTimer;
+        theTimer.interval( std::chrono::milliseconds(500) );
+        theTimer.elapse([ & ]()
+        {
+            theTimer.stop();
+
+            // in batches of 1024 values, as the drawing code converts them,
+            // then in one call for the whole array.
+            // The last batch holds the remainder, so both loops convert every value
+            std::stringstream ss;
+            for( int n : { 1024, COUNT } )
+            {
+                std::vector< int > one( COUNT ), batch( COUNT );
+                double msOne = best( [ & ]()
+                {
+                    for( int a = 0; a < COUNT; a += n )
+                        for( int k = a; k < std::min( a + n, COUNT ); k++ )
+                            one[ k ] = thePlot.X2Pixel( x[ k ] );
+                });
+                double msBatch = best( [ & ]()
+                {
+                    for( int a = 0; a < COUNT; a += n )
+                        thePlot.X2Pixel( x.data() + a, batch.data() + a, std::min( n, COUNT - a ) );
+                });
+                ss << COUNT << " values in batches of " << n << "\n"
+                   << "per point " << msOne << " ms\n"
+                   << "batched " << msBatch << " ms\n"
+                   << "speedup " << msOne / msBatch << "\n"
+                   << ( one == batch ? "same pixels" : "PIXELS DIFFER" ) << "\n\n";
+            }
+            std::cout << ss.str();
+            msgbox mb( ss.str() );
+            mb();
+        });
+        theTimer.start();
+
+        // show and run
+        fm.show();
+        exec();
+    }
+    catch( std::runtime_error& e )
+    {
+        msgbox mb( e.what() );
+        mb();
+    }
+}
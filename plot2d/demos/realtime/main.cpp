@@ -23,6 +23,9 @@ int main()
         // plot in blue
         t1.color( colors::blue );
 
+        // fix the y range so only new points need be drawn
+        thePlot.RealTimeScroll( -10, 10 );
+
         // create timer to provide new data regularly
         timer theTimer;
         theTimer.interval( std::chrono::milliseconds(10) );
@@ -1,6 +1,32 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <cstring>
+#include <chrono>
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define NANAPLOT_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(_MSC_VER) && ( defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) )
+#define NANAPLOT_X86
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include <nana/gui.hpp>
 #include "plot2d.h"
 namespace nana
@@ -10,353 +36,4006 @@ namespace plot
 
 plot::plot( window parent )
     : myParent( parent )
+    , myfStaticLayer( false )
+    , myfFixedY( false )
+    , myfScrollLayer( false )
+    , myfFrameTimer( false )
+    , myfDirty( false )
+    , myCoalesced( 0 )
+    , myHoverTrace( nullptr )
+    , myfSelecting( false )
+    , myfView( false )
+    , myfPanning( false )
+    , myMinX( 0 )
+    , myMaxX( 1 )
+    , myMinY( 0 )
+    , myMaxY( 1 )
+    , myXScale( 1 )
+    , myYScale( 1 )
+    , myXOffset( 0 )
+    , myYOffset( 0 )
 {
     RegisterDrawingFunction();
+    RegisterMouseFunctions();
 
     myAxis = new axis( this );
     myAxisX = new axis( this, true );
+
+    myFrameTimer.elapse([this]
+    {
+        Frame();
+    });
+    FrameRate( 60 );
+}
+
+void plot::FrameRate( int fps )
+{
+    myFrameRate = fps;
+    if( myfFrameTimer )
+    {
+        myFrameTimer.stop();
+        myfFrameTimer = false;
+    }
+    if( ! fps )
+        return;
+    myFrameTimer.interval( std::chrono::milliseconds( std::max( 1, 1000 / fps ) ) );
+    StartFrameTimer();
+}
+
+void plot::StartFrameTimer()
+{
+    if( myfFrameTimer || ! myFrameRate )
+        return;
+    myFrameTimer.start();
+    myfFrameTimer = true;
+}
+
+void plot::update()
+{
+    if( myfDirty )
+    {
+        // a repaint is already pending
+        myCoalesced++;
+        return;
+    }
+    myfDirty = true;
+    StartFrameTimer();
+}
+
+void plot::Repaint()
+{
+    if( myFrameRate )
+    {
+        update();
+        return;
+    }
+    // on demand mode has no frame timer, show the user's action now
+    myfDirty = true;
+    API::refresh_window( myParent );
+}
+
+void plot::Refresh()
+{
+    Drain();
+    myfDirty = true;
+    API::refresh_window( myParent );
+}
+
+void plot::Frame()
+{
+    if( Drain() )
+        update();
+
+    if( myfDirty )
+    {
+        API::refresh_window( myParent );
+        return;
+    }
+
+    // nothing to do, sleep unless there are realtime traces to drain
+    // or spectra and summaries that a worker thread may publish at any time
+    for( auto t : myTrace )
+        if( t->myQueue || t->mySpectrum || t->mySummary )
+            return;
+    myFrameTimer.stop();
+    myfFrameTimer = false;
+}
+
+bool plot::Drain()
+{
+    bool fchanged = false;
+    for( auto t : myTrace )
+        if( t->drain() )
+            fchanged = true;
+    return fchanged;
+}
+
+realtime_group& plot::AddRealTimeGroup( int w, int channels )
+{
+    if( w < 1 || channels < 1 )
+        throw std::runtime_error("nanaplot error: realtime group needs at least one channel and one sample");
+    realtime_group * g = new realtime_group();
+    g->myPlot = this;
+    g->myRing = std::make_shared< ring >( channels, w );
+    for( int c = 0; c < channels; c++ )
+    {
+        trace * t = new trace();
+        t->Plot( this );
+        t->realTime( g->myRing, c );
+        myTrace.push_back( t );
+        g->myTrace.push_back( t );
+    }
+    myGroup.push_back( g );
+    LayersChanged();
+    StartFrameTimer();
+    return *g;
+}
+
+void realtime_group::add( const double * frames, int count )
+{
+    if( count <= 0 )
+        return;
+    myRing->push( frames, count );
+    for( int c = 0; c < (int)myTrace.size(); c++ )
+    {
+        trace * t = myTrace[ c ];
+        t->pushBounds( count );
+        t->feed( frames + c, count, myTrace.size() );
+    }
+    myPlot->update();
+}
+
+/* Bit packing for the history blocks, most significant bit first */
+
+static int leadingZeros( uint64_t x )
+{
+    int n = 0;
+    for( uint64_t bit = 1ULL << 63; bit && ! ( x & bit ); bit >>= 1 )
+        n++;
+    return n;
+}
+
+static int trailingZeros( uint64_t x )
+{
+    int n = 0;
+    for( uint64_t bit = 1; bit && ! ( x & bit ); bit <<= 1 )
+        n++;
+    return n;
+}
+
+class bit_writer
+{
+public:
+    bit_writer( std::vector< unsigned char >& out )
+        : myOut( out )
+        , myBuf( 0 )
+        , myBits( 0 )
+    {
+
+    }
+    ~bit_writer()
+    {
+        // pad last byte with zeros
+        if( myBits )
+            myOut.push_back( (unsigned char)( myBuf << ( 8 - myBits ) ) );
+    }
+    void write( uint64_t v, int n )
+    {
+        if( n > 32 )
+        {
+            write( v >> 32, n - 32 );
+            n = 32;
+        }
+        // at most 7 bits wait in myBuf, so 32 more always fit
+        myBuf = ( myBuf << n ) | ( v & ( ( 1ULL << n ) - 1 ) );
+        myBits += n;
+        while( myBits >= 8 )
+        {
+            myBits -= 8;
+            myOut.push_back( (unsigned char)( myBuf >> myBits ) );
+        }
+    }
+private:
+    std::vector< unsigned char >& myOut;
+    uint64_t myBuf;
+    int myBits;                         ///< bits waiting in myBuf
+};
+
+class bit_reader
+{
+public:
+    bit_reader( const std::vector< unsigned char >& in )
+        : myIn( in.data() )
+        , myEnd( in.data() + in.size() )
+        , myBuf( 0 )
+        , myBits( 0 )
+    {
+
+    }
+    uint64_t read( int n )
+    {
+        if( n > 32 )
+        {
+            uint64_t high = read( n - 32 );
+            return ( high << 32 ) | read( 32 );
+        }
+        while( myBits < n )
+        {
+            // past the end read zeros, the padding of the last byte
+            myBuf = ( myBuf << 8 ) | ( myIn < myEnd ? *myIn++ : 0 );
+            myBits += 8;
+        }
+        myBits -= n;
+        return ( myBuf >> myBits ) & ( ( 1ULL << n ) - 1 );
+    }
+private:
+    const unsigned char * myIn;
+    const unsigned char * myEnd;
+    uint64_t myBuf;
+    int myBits;                         ///< bits waiting in myBuf
+};
+
+static uint64_t bitsOf( double v )
+{
+    uint64_t b;
+    memcpy( &b, &v, sizeof( b ) );
+    return b;
+}
+
+static double doubleOf( uint64_t b )
+{
+    double v;
+    memcpy( &v, &b, sizeof( v ) );
+    return v;
+}
+
+/* History block encodings
+
+    Each block starts with two bits giving how it is encoded,
+    the encoder tries those that apply and keeps the shortest.
+
+    XOR_PREVIOUS is the Gorilla encoding, each value XORed with the one before.
+
+    XOR_PREDICTED XORs each value with the straight line through the two before,
+    so a smooth signal leaves fewer differing bits.
+
+    SCALED applies when every value is an integer divided by 10^d, d < 8,
+    as are samples rounded to a few decimal places or integer ADC counts.
+    Values are kept exactly, except that -0 comes back as 0.
+    The integers are stored as first or second differences,
+    which are small for such signals, in a Rice code whose parameter suits the block.
+*/
+enum class eBlockCode
+{
+    XOR_PREVIOUS,
+    XOR_PREDICTED,
+    SCALED
+};
+
+static void encodeXOR( const double * y, int count, bool predict, bit_writer& out )
+{
+    uint64_t prev = bitsOf( y[ 0 ] );
+    out.write( prev, 64 );
+    int lead = -1, trail = 0;           // meaningful bits of previous XOR
+    for( int k = 1; k < count; k++ )
+    {
+        uint64_t v = bitsOf( y[ k ] );
+        uint64_t x = v ^ prev;
+        if( predict && k > 1 )
+            x = v ^ bitsOf( 2 * y[ k - 1 ] - y[ k - 2 ] );
+        prev = v;
+        if( ! x )
+        {
+            // same value as before, or as predicted
+            out.write( 0, 1 );
+            continue;
+        }
+        out.write( 1, 1 );
+        int lz = std::min( 31, leadingZeros( x ) );
+        int tz = trailingZeros( x );
+        if( lead >= 0 && lz >= lead && tz >= trail )
+        {
+            // differing bits fit in the previous window
+            out.write( 0, 1 );
+            out.write( x >> trail, 64 - lead - trail );
+            continue;
+        }
+        lead = lz;
+        trail = tz;
+        int len = 64 - lz - tz;
+        out.write( 1, 1 );
+        out.write( lz, 5 );
+        out.write( len - 1, 6 );
+        out.write( x >> tz, len );
+    }
+}
+
+static void decodeXOR( bit_reader& in, double * y, int count, bool predict )
+{
+    uint64_t prev = in.read( 64 );
+    y[ 0 ] = doubleOf( prev );
+    int lead = 0, trail = 0;
+    for( int i = 1; i < count; i++ )
+    {
+        if( predict && i > 1 )
+            prev = bitsOf( 2 * y[ i - 1 ] - y[ i - 2 ] );
+        if( in.read( 1 ) )
+        {
+            if( in.read( 1 ) )
+            {
+                lead = in.read( 5 );
+                int len = in.read( 6 ) + 1;
+                trail = 64 - lead - len;
+            }
+            prev ^= in.read( 64 - lead - trail ) << trail;
+        }
+        y[ i ] = doubleOf( prev );
+        prev = bitsOf( y[ i ] );
+    }
+}
+
+/// quotients at or above this are written in full
+static const int RICE_ESCAPE = 32;
+
+static uint64_t zigzag( int64_t r )
+{
+    return ( (uint64_t)r << 1 ) ^ (uint64_t)( r >> 63 );
+}
+
+static int64_t unzigzag( uint64_t z )
+{
+    return (int64_t)( ( z >> 1 ) ^ ( ~( z & 1 ) + 1 ) );
+}
+
+/// bits to Rice code z with parameter k
+static long long riceBits( uint64_t z, int k )
+{
+    uint64_t q = z >> k;
+    return q < RICE_ESCAPE ? q + 1 + k : RICE_ESCAPE + 64;
+}
+
+/// residuals of n after removing differences of order 1 or 2
+static void residuals( const std::vector< int64_t >& n, int order, std::vector< uint64_t >& z )
+{
+    z.resize( n.size() - 1 );
+    for( size_t i = 1; i < n.size(); i++ )
+    {
+        int64_t r = n[ i ] - n[ i - 1 ];
+        if( order == 2 && i > 1 )
+            r -= n[ i - 1 ] - n[ i - 2 ];
+        z[ i - 1 ] = zigzag( r );
+    }
+}
+
+/// Rice parameter near the mean residual, refined by the exact bit count
+static int riceParameter( const std::vector< uint64_t >& z, long long& bits )
+{
+    double mean = 0;
+    for( uint64_t v : z )
+        mean += v;
+    mean /= z.size();
+    int guess = mean < 1 ? 0 : std::min( 31, (int)log2( mean ) );
+    int best = 0;
+    bits = std::numeric_limits< long long >::max();
+    for( int k = std::max( 0, guess - 1 ); k <= std::min( 31, guess + 1 ); k++ )
+    {
+        long long b = 0;
+        for( uint64_t v : z )
+            b += riceBits( v, k );
+        if( b < bits )
+        {
+            bits = b;
+            best = k;
+        }
+    }
+    return best;
+}
+
+/** \brief encode as scaled integers
+    @return false if the values are not all integers divided by a power of ten
+*/
+static bool encodeScaled( const double * y, int count, bit_writer& out )
+{
+    // the fewest decimal places that reproduce every value exactly
+    std::vector< int64_t > n( count );
+    int places = -1;
+    double scale = 1;
+    for( int d = 0; d < 8 && places < 0; d++, scale *= 10 )
+    {
+        int k = 0;
+        for( ; k < count; k++ )
+        {
+            double v = y[ k ] * scale;
+            if( ! ( fabs( v ) < 4503599627370496.0 ) )         // 2^52, also rejects NaN
+                break;
+            n[ k ] = llround( v );
+            if( n[ k ] / scale != y[ k ] )
+                break;
+        }
+        if( k == count )
+            places = d;
+    }
+    if( places < 0 )
+        return false;
+
+    // first or second differences, whichever codes shorter
+    std::vector< uint64_t > z1, z2;
+    residuals( n, 1, z1 );
+    residuals( n, 2, z2 );
+    long long bits1, bits2;
+    int k1 = riceParameter( z1, bits1 );
+    int k2 = riceParameter( z2, bits2 );
+    int order = bits1 <= bits2 ? 1 : 2;
+    int k = order == 1 ? k1 : k2;
+    const std::vector< uint64_t >& z = order == 1 ? z1 : z2;
+
+    out.write( places, 3 );
+    out.write( order - 1, 1 );
+    out.write( k, 5 );
+    out.write( zigzag( n[ 0 ] ), 64 );
+    for( uint64_t v : z )
+    {
+        uint64_t q = v >> k;
+        if( q < RICE_ESCAPE )
+        {
+            out.write( ( 1ULL << q ) - 1, q );
+            out.write( 0, 1 );
+            out.write( v, k );
+        }
+        else
+        {
+            out.write( ( 1ULL << RICE_ESCAPE ) - 1, RICE_ESCAPE );
+            out.write( v, 64 );
+        }
+    }
+    return true;
+}
+
+static void decodeScaled( bit_reader& in, double * y, int count )
+{
+    int places = in.read( 3 );
+    int order = in.read( 1 ) + 1;
+    int k = in.read( 5 );
+    double scale = 1;
+    for( int d = 0; d < places; d++ )
+        scale *= 10;
+    int64_t n = unzigzag( in.read( 64 ) );
+    int64_t delta = 0;
+    y[ 0 ] = n / scale;
+    for( int i = 1; i < count; i++ )
+    {
+        uint64_t q = 0;
+        while( q < RICE_ESCAPE && in.read( 1 ) )
+            q++;
+        uint64_t z = q < RICE_ESCAPE
+                     ? ( q << k ) | in.read( k )
+                     : in.read( 64 );
+        int64_t r = unzigzag( z );
+        delta = ( order == 2 && i > 1 ) ? delta + r : r;
+        n += delta;
+        y[ i ] = n / scale;
+    }
+}
+
+const int history_store::BLOCK;
+const int spectrum_worker::FRESH;
+
+spectrum_worker::spectrum_worker( int size, int hop )
+    : myFront( 0 )
+    , myBack( 1 )
+    , myMiddle( 2 )
+    , mySize( size )
+    , myHop( hop )
+    , myCos( size / 2 )
+    , mySin( size / 2 )
+    , myReverse( size )
+    , myRe( size )
+    , myIm( size )
+    , myQueue( std::max( 16384, 4 * size ) )
+    , myfStop( false )
+{
+    for( auto& r : myBuffer )
+    {
+        r.min = r.max = 0;
+    }
+
+    // Hann window
+    const double PI = 3.14159265358979323846;
+    myWindow.resize( size );
+    double sum = 0;
+    for( int k = 0; k < size; k++ )
+    {
+        myWindow[ k ] = 0.5 - 0.5 * cos( 2 * PI * k / size );
+        sum += myWindow[ k ];
+    }
+    myGain = 2 / sum;
+
+    for( int k = 0; k < size / 2; k++ )
+    {
+        myCos[ k ] = cos( 2 * PI * k / size );
+        mySin[ k ] = -sin( 2 * PI * k / size );
+    }
+    int bits = 0;
+    while( ( 1 << bits ) < size )
+        bits++;
+    for( int k = 0; k < size; k++ )
+    {
+        int r = 0;
+        for( int b = 0; b < bits; b++ )
+            if( k & ( 1 << b ) )
+                r |= 1 << ( bits - 1 - b );
+        myReverse[ k ] = r;
+    }
+
+    myThread = std::thread( &spectrum_worker::run, this );
+}
+
+spectrum_worker::~spectrum_worker()
+{
+    myfStop = true;
+    myWake.notify_one();
+    myThread.join();
+}
+
+void spectrum_worker::push( const double * y, int count, int stride )
+{
+    for( int k = 0; k < count; k++ )
+        myQueue.push( y[ (size_t)k * stride ] );
+    myWake.notify_one();
+}
+
+bool spectrum_worker::acquire()
+{
+    if( ! ( myMiddle.load( std::memory_order_acquire ) & FRESH ) )
+        return false;
+    myFront = myMiddle.exchange( myFront, std::memory_order_acq_rel ) & ~FRESH;
+    return true;
+}
+
+void spectrum_worker::run()
+{
+    std::vector< double > pending;
+    double batch[ 1024 ];
+    while( ! myfStop )
+    {
+        int count;
+        while( ( count = myQueue.pop( batch, 1024 ) ) > 0 )
+            pending.insert( pending.end(), batch, batch + count );
+
+        if( (int)pending.size() >= mySize )
+        {
+            // only the newest complete frame will be seen, skip older ones
+            size_t skip = ( pending.size() - mySize ) / myHop * myHop;
+            transform( pending.data() + skip, myBuffer[ myBack ] );
+            pending.erase( pending.begin(), pending.begin() + skip + myHop );
+
+            // publish, taking the buffer the plot is finished with
+            myBack = myMiddle.exchange( myBack | FRESH, std::memory_order_acq_rel ) & ~FRESH;
+            continue;
+        }
+
+        // wait for samples, the timeout covers a wake up sent before we wait
+        std::unique_lock< std::mutex > lock( myWakeMutex );
+        myWake.wait_for( lock, std::chrono::milliseconds( 10 ) );
+    }
+}
+
+void spectrum_worker::transform( const double * frame, result& r )
+{
+    int n = mySize;
+    for( int k = 0; k < n; k++ )
+    {
+        myRe[ myReverse[ k ] ] = frame[ k ] * myWindow[ k ];
+        myIm[ myReverse[ k ] ] = 0;
+    }
+
+    // iterative radix-2 decimation in time
+    for( int len = 2; len <= n; len *= 2 )
+    {
+        int half = len / 2;
+        int step = n / len;
+        for( int i = 0; i < n; i += len )
+        {
+            for( int j = 0; j < half; j++ )
+            {
+                double wr = myCos[ j * step ];
+                double wi = mySin[ j * step ];
+                int a = i + j;
+                int b = a + half;
+                double tr = myRe[ b ] * wr - myIm[ b ] * wi;
+                double ti = myRe[ b ] * wi + myIm[ b ] * wr;
+                myRe[ b ] = myRe[ a ] - tr;
+                myIm[ b ] = myIm[ a ] - ti;
+                myRe[ a ] += tr;
+                myIm[ a ] += ti;
+            }
+        }
+    }
+
+    // magnitude in dB, floored at -200 dB
+    r.y.resize( n / 2 + 1 );
+    for( int k = 0; k <= n / 2; k++ )
+    {
+        double gain = ( k == 0 || k == n / 2 ) ? myGain / 2 : myGain;
+        double mag = gain * sqrt( myRe[ k ] * myRe[ k ] + myIm[ k ] * myIm[ k ] );
+        r.y[ k ] = 20 * log10( std::max( mag, 1e-10 ) );
+    }
+    auto range = std::minmax_element( r.y.begin(), r.y.end() );
+    r.min = *range.first;
+    r.max = *range.second;
+}
+
+const int summary_worker::BINS;
+
+summary_worker::summary_worker( const series& y, const series& x, std::shared_ptr< mapped_file > file )
+    : myY( y )
+    , myX( x )
+    , myFile( file )
+    , myfStop( false )
+    , myfReady( false )
+    , myfReadyTaken( false )
+{
+    myThread = std::thread( &summary_worker::run, this );
+}
+
+summary_worker::~summary_worker()
+{
+    myfStop = true;
+    myThread.join();
+}
+
+bool summary_worker::acquire( std::vector< bin >& bins )
+{
+    // completion is read first, so the bins published before it are all taken
+    bool ready = myfReady;
+    size_t before = bins.size();
+    {
+        std::lock_guard< std::mutex > lock( myMutex );
+        bins.insert( bins.end(), myBins.begin(), myBins.end() );
+        myBins.clear();
+    }
+    if( ready && ! myfReadyTaken )
+    {
+        myfReadyTaken = true;
+        return true;
+    }
+    return bins.size() > before;
+}
+
+void summary_worker::take( pyramid& p )
+{
+    p = std::move( myPyramid );
+}
+
+void summary_worker::run()
+{
+    // chunks of samples between publishing bins and checking for stop
+    const long long CHUNK = 1 << 22;
+
+    long long n = myY.size();
+    long long binSize = std::max( 1LL, ( n + BINS - 1 ) / BINS );
+    long long next = 0;                 // first sample of next bin
+    if( myFile )
+        myFile->sequential( true );
+    for( long long a = 0; a < n && ! myfStop; a += CHUNK )
+    {
+        long long b = std::min( n, a + CHUNK );
+        myPyramid.update( myY, a, b );
+
+        // bins wholly summarized, their min and max come from the pyramid
+        std::vector< bin > fresh;
+        while( next < n && std::min( n, next + binSize ) <= b )
+        {
+            long long end = std::min( n, next + binSize );
+            bin k;
+            k.x = myX.size() ? myX[ next ] : next;
+            myPyramid.range( myY, next, end, k.min, k.max );
+            fresh.push_back( k );
+            next = end;
+        }
+        std::lock_guard< std::mutex > lock( myMutex );
+        myBins.insert( myBins.end(), fresh.begin(), fresh.end() );
+    }
+    if( myFile )
+        myFile->sequential( false );
+    if( ! myfStop )
+        myfReady = true;
+}
+
+history_store::history_store( long long keep )
+    : myFirstBlock( 0 )
+    , myKeep( keep )
+    , myTotal( 0 )
+    , myBytes( 0 )
+    , myFileEnd( 0 )
+    , myMemory( 0 )
+    , myResident( 0 )
+    , myResidentBlock( 0 )
+    , myCacheBlock( -1 )
+{
+    myOpen.reserve( BLOCK );
+}
+
+/* Spill file record
+
+    uint32  magic
+    uint32  length of encoded samples
+    int64   number of first sample
+    double  min
+    double  max
+    uint32  checksum of the fields above and the encoded samples
+    length bytes of encoded samples
+
+    in the byte order of the machine that wrote it
+*/
+static const uint32_t SPILL_MAGIC = 0x3248504E;
+static const int SPILL_HEADER = 36;
+
+/// FNV-1a hash
+static uint32_t checksum( const unsigned char * p, size_t n, uint32_t h = 2166136261u )
+{
+    for( size_t k = 0; k < n; k++ )
+        h = ( h ^ p[ k ] ) * 16777619u;
+    return h;
+}
+
+void history_store::spill( const std::string& path, long long memory )
+{
+    myMemory = memory;
+    myFile.open( path, std::ios::in | std::ios::out | std::ios::binary );
+    if( ! myFile.is_open() )
+    {
+        // create file
+        myFile.clear();
+        myFile.open( path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc );
+    }
+    if( ! myFile.is_open() )
+        throw std::runtime_error("nanaplot error: cannot open history spill file " + path );
+    recover();
+}
+
+void history_store::recover()
+{
+    std::vector< unsigned char > head( SPILL_HEADER );
+    std::vector< unsigned char > bits;
+    myFile.seekg( 0 );
+    while( myFile.read( (char*)head.data(), SPILL_HEADER ) )
+    {
+        uint32_t magic, length, sum;
+        long long first;
+        block b;
+        memcpy( &magic, &head[0], 4 );
+        memcpy( &length, &head[4], 4 );
+        memcpy( &first, &head[8], 8 );
+        memcpy( &b.min, &head[16], 8 );
+        memcpy( &b.max, &head[24], 8 );
+        memcpy( &sum, &head[32], 4 );
+        if( magic != SPILL_MAGIC || length > 16 * BLOCK )
+            break;
+
+        // blocks must follow on from each other
+        if( first % BLOCK || ( myBlock.size() && first != myTotal ) )
+            break;
+
+        bits.resize( length );
+        if( ! myFile.read( (char*)bits.data(), length ) )
+            break;
+        if( checksum( bits.data(), length, checksum( head.data(), 32 ) ) != sum )
+            break;
+
+        // complete record, keep it in the file only
+        if( myBlock.empty() )
+            myFirstBlock = myResidentBlock = first / BLOCK;
+        b.offset = myFileEnd;
+        b.length = length;
+        myBlock.push_back( b );
+        myTotal = first + BLOCK;
+        myBytes += length;
+        myFileEnd += SPILL_HEADER + length;
+    }
+
+    // anything after the last complete record is overwritten by the next block
+    myFile.clear();
+
+    while( myBlock.size() > 1
+            && myTotal - ( myFirstBlock + 1 ) * BLOCK >= myKeep )
+    {
+        myBytes -= myBlock.front().length;
+        myBlock.pop_front();
+        myFirstBlock++;
+    }
+    myResidentBlock = std::max( myResidentBlock, myFirstBlock );
+}
+
+void history_store::push( const double * y, int count, int stride )
+{
+    for( int k = 0; k < count; k++ )
+    {
+        myOpen.push_back( y[ (size_t)k * stride ] );
+        myTotal++;
+        if( (int)myOpen.size() == BLOCK )
+            seal();
+    }
+}
+
+void history_store::encode( std::vector< unsigned char >& bits ) const
+{
+    // try each encoding that applies, keep the shortest
+    std::vector< unsigned char > best, trial;
+    for( auto code : { eBlockCode::SCALED, eBlockCode::XOR_PREDICTED, eBlockCode::XOR_PREVIOUS } )
+    {
+        trial.clear();
+        {
+            bit_writer out( trial );
+            out.write( (int)code, 2 );
+            if( code == eBlockCode::SCALED )
+            {
+                if( ! encodeScaled( myOpen.data(), BLOCK, out ) )
+                    continue;
+            }
+            else
+                encodeXOR( myOpen.data(), BLOCK, code == eBlockCode::XOR_PREDICTED, out );
+        }
+        if( best.empty() || trial.size() < best.size() )
+            best.swap( trial );
+    }
+    bits.swap( best );
+}
+
+void history_store::write( block& b, long long first )
+{
+    std::vector< unsigned char > record( SPILL_HEADER + b.length );
+    uint32_t magic = SPILL_MAGIC;
+    memcpy( &record[0], &magic, 4 );
+    memcpy( &record[4], &b.length, 4 );
+    memcpy( &record[8], &first, 8 );
+    memcpy( &record[16], &b.min, 8 );
+    memcpy( &record[24], &b.max, 8 );
+    std::copy( b.bits.begin(), b.bits.end(), record.begin() + SPILL_HEADER );
+    uint32_t sum = checksum( &record[SPILL_HEADER], b.length, checksum( record.data(), 32 ) );
+    memcpy( &record[32], &sum, 4 );
+
+    // one write, flushed, so a crash leaves at most one incomplete record at the end
+    myFile.seekp( myFileEnd );
+    myFile.write( (const char*)record.data(), record.size() );
+    myFile.flush();
+    if( ! myFile )
+        throw std::runtime_error("nanaplot error: cannot write history spill file");
+    b.offset = myFileEnd;
+    myFileEnd += record.size();
+}
+
+void history_store::seal()
+{
+    block b;
+    b.min = *std::min_element( myOpen.begin(), myOpen.end() );
+    b.max = *std::max_element( myOpen.begin(), myOpen.end() );
+    b.offset = -1;
+
+    encode( b.bits );
+    b.bits.shrink_to_fit();
+    b.length = b.bits.size();
+    myBytes += b.length;
+    myResident += b.length;
+    if( myFile.is_open() )
+        write( b, myTotal - BLOCK );
+    myBlock.push_back( std::move( b ) );
+    myOpen.clear();
+
+    // discard blocks no longer needed to keep the most recent samples
+    while( myBlock.size() > 1
+            && myTotal - ( myFirstBlock + 1 ) * BLOCK >= myKeep )
+    {
+        myBytes -= myBlock.front().length;
+        myResident -= myBlock.front().bits.size();
+        myBlock.pop_front();
+        myFirstBlock++;
+    }
+    myResidentBlock = std::max( myResidentBlock, myFirstBlock );
+
+    // free memory of the oldest blocks, they can be read back from the spill file
+    if( myFile.is_open() )
+    {
+        while( myResident > myMemory
+                && myResidentBlock < myFirstBlock + (long long)myBlock.size() - 1 )
+        {
+            block& old = myBlock[ myResidentBlock - myFirstBlock ];
+            myResident -= old.bits.size();
+            std::vector< unsigned char >().swap( old.bits );
+            myResidentBlock++;
+        }
+    }
+}
+
+const double * history_store::samples( long long k ) const
+{
+    long long sealed = myFirstBlock + myBlock.size();
+    if( k == sealed )
+        return myOpen.data();
+    if( k == myCacheBlock )
+        return myCache.data();
+
+    const block& b = myBlock[ k - myFirstBlock ];
+    if( b.bits.size() == b.length )
+        decode( b.bits );
+    else
+    {
+        // spilled block, read it back
+        std::vector< unsigned char > bits( b.length );
+        myFile.clear();
+        myFile.seekg( b.offset + SPILL_HEADER );
+        if( ! myFile.read( (char*)bits.data(), b.length ) )
+            throw std::runtime_error("nanaplot error: cannot read history spill file");
+        decode( bits );
+    }
+    myCacheBlock = k;
+    return myCache.data();
+}
+
+void history_store::decode( const std::vector< unsigned char >& bits ) const
+{
+    bit_reader in( bits );
+    myCache.resize( BLOCK );
+    eBlockCode code = (eBlockCode)in.read( 2 );
+    if( code == eBlockCode::SCALED )
+        decodeScaled( in, myCache.data(), BLOCK );
+    else
+        decodeXOR( in, myCache.data(), BLOCK, code == eBlockCode::XOR_PREDICTED );
+}
+
+void history_store::range( long long first, long long last, double& mn, double& mx ) const
+{
+    mn = std::numeric_limits< double >::max();
+    mx = -mn;
+    long long sealed = myFirstBlock + myBlock.size();
+    while( first < last )
+    {
+        long long k = first / BLOCK;
+        long long end = std::min( last, ( k + 1 ) * BLOCK );
+        if( first == k * BLOCK && end == ( k + 1 ) * BLOCK && k < sealed )
+        {
+            // whole block, use its summary
+            const block& b = myBlock[ k - myFirstBlock ];
+            mn = std::min( mn, b.min );
+            mx = std::max( mx, b.max );
+        }
+        else
+        {
+            const double * y = samples( k );
+            for( long long i = first; i < end; i++ )
+            {
+                mn = std::min( mn, y[ i - k * BLOCK ] );
+                mx = std::max( mx, y[ i - k * BLOCK ] );
+            }
+        }
+        first = end;
+    }
+}
+
+void history_store::read( long long first, long long last, double * y ) const
+{
+    while( first < last )
+    {
+        long long k = first / BLOCK;
+        long long end = std::min( last, ( k + 1 ) * BLOCK );
+        const double * b = samples( k );
+        y = std::copy( b + first - k * BLOCK, b + end - k * BLOCK, y );
+        first = end;
+    }
+}
+
+void ring::push( const double * frames, int count )
+{
+    if( count <= 0 )
+        return;
+    myTotal += count;
+
+    // only the most recent frames fit in the window
+    if( count >= myWidth )
+    {
+        frames += (size_t)( count - myWidth ) * myChannels;
+        count = myWidth;
+        myNext = 0;
+    }
+
+    // copy up to the end of the circular buffer, then wrap around
+    int tail = std::min( count, myWidth - myNext );
+    if( myChannels == 1 )
+    {
+        std::copy( frames, frames + tail, myData.begin() + myNext );
+        std::copy( frames + tail, frames + count, myData.begin() );
+    }
+    else
+    {
+        // write each channel block in turn, reading the frames with a stride
+        for( int c = 0; c < myChannels; c++ )
+        {
+            double * dst = myData.data() + (size_t)c * myWidth;
+            const double * src = frames + c;
+            for( int f = 0; f < tail; f++ )
+                dst[ myNext + f ] = src[ (size_t)f * myChannels ];
+            for( int f = tail; f < count; f++ )
+                dst[ f - tail ] = src[ (size_t)f * myChannels ];
+        }
+    }
+    myNext = ( myNext + count ) % myWidth;
+}
+
+trace& plot::AddTimedTrace( double duration )
+{
+    if( ! ( duration > 0 ) )
+        throw std::runtime_error("nanaplot error: timed trace duration must be positive");
+    trace * t = new trace();
+    t->Plot( this );
+    t->timed( duration );
+    myTrace.push_back( t );
+    StartFrameTimer();
+    return *t;
+}
+
+trace& plot::AddHistogramTrace( double min, double max, int bins, bool expand )
+{
+    if( ! ( max > min ) || bins <= 0 )
+        throw std::runtime_error("nanaplot error: histogram needs bins of positive width");
+    trace * t = new trace();
+    t->Plot( this );
+    t->histogram( min, max, bins, expand );
+    myTrace.push_back( t );
+    StartFrameTimer();
+    return *t;
+}
+
+trace& plot::AddWaterfallTrace( int columns, int rows, double min, double max )
+{
+    if( columns <= 0 || rows <= 0 )
+        throw std::runtime_error("nanaplot error: waterfall needs rows and columns");
+    if( ! ( max > min ) )
+        throw std::runtime_error("nanaplot error: waterfall colour range is empty");
+    trace * t = new trace();
+    t->Plot( this );
+    t->waterfall( columns, rows, min, max );
+    myTrace.push_back( t );
+    StartFrameTimer();
+    return *t;
+}
+
+trace& plot::AddSpectrumTrace( trace& source, int size, int hop, double rate )
+{
+    if( source.myType != trace::eType::realtime )
+        throw std::runtime_error("nanaplot error: spectrum source is not a realtime trace");
+    if( size < 2 || ( size & ( size - 1 ) ) )
+        throw std::runtime_error("nanaplot error: spectrum size must be a power of 2");
+    if( ! hop )
+        hop = size / 2;
+    if( hop < 0 || hop > size )
+        throw std::runtime_error("nanaplot error: spectrum hop must be between 1 and size");
+    trace * t = new trace();
+    t->Plot( this );
+    t->myType = trace::eType::spectrum;
+    t->mySpectrum = std::make_shared< spectrum_worker >( size, hop );
+    t->myBinScale = rate > 0 ? rate / size : 1;
+    source.mySpectra.push_back( t->mySpectrum );
+    myTrace.push_back( t );
+    StartFrameTimer();
+    return *t;
+}
+
+trace& plot::AddScatterTrace()
+{
+    trace * t = new trace();
+    t->Plot( this );
+    t->scatter();
+    myTrace.push_back( t );
+    LayersChanged();
+    return *t;
+}
+
+void plot::RegisterDrawingFunction()
+{
+    /* The drawing object is just defined as a local variable
+
+    When the drawing object gets destroyed, the drawer functions are still alive.
+    The drawing object doesn't manage the life-time of drawer functions,
+    it is just for installing drawer functions.
+    The parent window may outlive the plot, so the plot erases its drawer
+    when it is destroyed.
+
+    */
+    myDrawer = drawing( myParent ).draw_diehard([this](paint::graphics& graph)
+    {
+        // this paint satisfies any pending repaint request
+        myfDirty = false;
+
+        // check there are traces that need to be drawn
+        if( ! myTrace.size() )
+            return;
+
+        // calculate scaling factors
+        // so plot will fit
+        CalcScale(
+            graph.width(),
+            graph.height() );
+
+        // scroll realtime trace, if possible
+        if( DrawScroll( graph ) )
+            return;
+
+        // copy axis and traces that have not changed
+        DrawStaticLayer( graph );
+        graph.bitblt( rectangle( graph.size() ), myStaticLayer );
+
+        // draw realtime traces
+        bool frealtime = false;
+        for( auto t : myTrace )
+            if( t->live() )
+                frealtime = true;
+        if( frealtime )
+        {
+            rasterizer r( graph );
+            for( auto t : myTrace )
+            {
+                if( t->live() )
+                    t->update( r );
+            }
+            r.paste();
+        }
+
+        DrawOverlay( graph );
+    });
+}
+
+void plot::RegisterMouseFunctions()
+{
+    auto& events = API::events( myParent );
+    myEvents.push_back( events.mouse_down([this]( const arg_mouse& arg )
+    {
+        if( arg.right_button )
+        {
+            // start dragging the view
+            myfPanning = true;
+            myPanStart = arg.pos;
+            ShownView( myPanMinX, myPanMaxX, myPanMinY, myPanMaxY );
+            return;
+        }
+        if( ! arg.left_button )
+            return;
+
+        // only scatter points can be selected
+        bool fScatter = false;
+        for( auto t : myTrace )
+            if( t->myType == trace::eType::scatter )
+                fScatter = true;
+        if( ! fScatter )
+            return;
+        myfSelecting = true;
+        mySelectStart = mySelectEnd = arg.pos;
+    }));
+    myEvents.push_back( events.mouse_move([this]( const arg_mouse& arg )
+    {
+        if( myfPanning )
+        {
+            double dx = ( arg.pos.x - myPanStart.x ) / myXScale;
+            double dy = ( arg.pos.y - myPanStart.y ) / myYScale;
+            SetView( myPanMinX - dx, myPanMaxX - dx, myPanMinY + dy, myPanMaxY + dy );
+        }
+        else if( myfSelecting )
+        {
+            mySelectEnd = arg.pos;
+            Repaint();
+        }
+        else if( Hover( arg.pos ) )
+            Repaint();
+    }));
+    myEvents.push_back( events.mouse_wheel([this]( const arg_wheel& arg )
+    {
+        Zoom( arg.pos, arg.upwards ? 0.8 : 1.25 );
+    }));
+    myEvents.push_back( events.mouse_up([this]( const arg_mouse& arg )
+    {
+        if( myfPanning )
+        {
+            myfPanning = false;
+            return;
+        }
+        if( ! myfSelecting )
+            return;
+        mySelectEnd = arg.pos;
+        myfSelecting = false;
+        Select();
+        Repaint();
+        if( mySelectHandler )
+            mySelectHandler();
+    }));
+    myEvents.push_back( events.mouse_leave([this]( const arg_mouse& )
+    {
+        if( myHoverTrace )
+        {
+            myHoverTrace = nullptr;
+            Repaint();
+        }
+    }));
+}
+
+void plot::SetView( double xmin, double xmax, double ymin, double ymax )
+{
+    if( ! ( xmin < xmax && ymin < ymax ) )
+        throw std::runtime_error("nanaplot error: empty view");
+    myfView = true;
+    myViewMinX = xmin;
+    myViewMaxX = xmax;
+    myViewMinY = ymin;
+    myViewMaxY = ymax;
+    myHoverTrace = nullptr;
+    LayersChanged();
+    Repaint();
+}
+
+void plot::FitView()
+{
+    myfView = false;
+    myHoverTrace = nullptr;
+    LayersChanged();
+    Repaint();
+}
+
+/// true if a range is too narrow to scale to the window, the limit of plot::Zoom
+static bool flatRange( double mn, double mx )
+{
+    return ! ( mx - mn >= 1e-9 * std::max( 1.0, std::max( fabs( mn ), fabs( mx ) ) ) );
+}
+
+void plot::ShownView( double& xmin, double& xmax, double& ymin, double& ymax ) const
+{
+    if( myfView )
+    {
+        xmin = myViewMinX;
+        xmax = myViewMaxX;
+        ymin = myViewMinY;
+        ymax = myViewMaxY;
+        return;
+    }
+
+    // the data range, widened as CalcScale does when it is flat
+    xmin = myMinX;
+    xmax = myMaxX;
+    ymin = myMinY;
+    ymax = myMaxY;
+    if( flatRange( xmin, xmax ) || flatRange( ymin, ymax ) )
+    {
+        nana::size sz = API::window_size( myParent );
+        int w = sz.width;
+        int h = sz.height;
+        w *= 0.9;
+        h *= 0.95;
+        if( flatRange( xmin, xmax ) )
+            xmax = xmin + 0.9 * std::max( w, 1 ) / myXScale;
+        if( flatRange( ymin, ymax ) )
+            ymax = ymin + 0.9 * std::max( h, 1 ) / myYScale;
+    }
+}
+
+void plot::Zoom( const point& p, double f )
+{
+    if( ! myTrace.size() )
+        return;
+    double xmin, xmax, ymin, ymax;
+    ShownView( xmin, xmax, ymin, ymax );
+
+    // keep the value under the mouse where it is
+    double x = Pixel2X( p.x );
+    double y = Pixel2Y( p.y );
+    xmin = x - f * ( x - xmin );
+    xmax = x + f * ( xmax - x );
+    ymin = y - f * ( y - ymin );
+    ymax = y + f * ( ymax - y );
+
+    // stop before the scale loses precision
+    if( flatRange( xmin, xmax ) || flatRange( ymin, ymax ) )
+        return;
+    SetView( xmin, xmax, ymin, ymax );
+}
+
+bool plot::Hover( const point& p )
+{
+    if( ! myTrace.size() )
+        return false;
+    const int RADIUS = 8;
+    trace * found = nullptr;
+    long long index = -1;
+    long long best = 0;
+    for( auto t : myTrace )
+    {
+        if( t->myType != trace::eType::scatter )
+            continue;
+        long long d;
+        long long i = t->nearest( p, RADIUS, d );
+        if( i < 0 )
+            continue;
+        if( ! found || d < best )
+        {
+            found = t;
+            index = i;
+            best = d;
+        }
+    }
+    if( found == myHoverTrace && index == myHoverIndex )
+        return false;
+    myHoverTrace = found;
+    myHoverIndex = index;
+    return true;
+}
+
+void plot::Select()
+{
+    double x0 = Pixel2X( std::min( mySelectStart.x, mySelectEnd.x ) );
+    double x1 = Pixel2X( std::max( mySelectStart.x, mySelectEnd.x ) );
+    double y0 = Pixel2Y( std::max( mySelectStart.y, mySelectEnd.y ) );
+    double y1 = Pixel2Y( std::min( mySelectStart.y, mySelectEnd.y ) );
+    for( auto t : myTrace )
+    {
+        if( t->myType != trace::eType::scatter )
+            continue;
+        t->mySelected.clear();
+        t->inside( x0, x1, y0, y1, t->mySelected );
+    }
+}
+
+void plot::DrawOverlay( paint::graphics& graph )
+{
+    if( myfSelecting )
+    {
+        int x = std::min( mySelectStart.x, mySelectEnd.x );
+        int y = std::min( mySelectStart.y, mySelectEnd.y );
+        graph.rectangle(
+            rectangle( x, y,
+                       std::abs( mySelectEnd.x - mySelectStart.x ) + 1,
+                       std::abs( mySelectEnd.y - mySelectStart.y ) + 1 ),
+            false,
+            colors::black );
+    }
+    if( myHoverTrace )
+    {
+        double x = myHoverTrace->x( myHoverIndex );
+        double y = myHoverTrace->y( myHoverIndex );
+        point p( X2Pixel( x ), Y2Pixel( y ) );
+        graph.rectangle( rectangle( p.x - 6, p.y - 6, 13, 13 ), false, colors::black );
+        char text[ 64 ];
+        snprintf( text, sizeof( text ), "%g, %g", x, y );
+        graph.string( point( p.x + 10, p.y - 20 ), text, colors::black );
+    }
+}
+
+void plot::RealTimeScroll( double ymin, double ymax )
+{
+    myfFixedY = true;
+    myFixedMinY = ymin;
+    myFixedMaxY = ymax;
+    LayersChanged();
+}
+
+bool plot::DrawScroll( paint::graphics& graph )
+{
+    if( ! myfFixedY || myfView )
+        return false;
+
+    // all traces must be realtime, sharing one timebase
+    for( auto t : myTrace )
+        if( t->myType != trace::eType::realtime
+                || t->myRing != myTrace[0]->myRing )
+            return false;
+    trace& t = *myTrace[0];
+    int w = t.myRing->width();
+    long long total = t.myRing->total();
+    int xlast = X2Pixel( w - 1 );
+
+    if( ! myfScrollLayer
+            || myScrollLayer.size() != graph.size()
+            || myScrollXScale != myXScale
+            || myScrollYScale != myYScale
+            || myScrollXOffset != myXOffset
+            || myScrollYOffset != myYOffset
+            || total - myScrollTotal >= w )
+    {
+        // draw whole trace on the background
+        myScrollBackground.make( graph.size() );
+        myScrollBackground.bitblt( rectangle( graph.size() ), graph );
+        myScrollLayer.make( graph.size() );
+        myScrollLayer.bitblt( rectangle( graph.size() ), graph );
+        rasterizer r( myScrollLayer );
+        for( auto rt : myTrace )
+            rt->scrollUpdate( r, total - w, total, xlast );
+        r.paste();
+
+        myfScrollLayer = true;
+        myScrollXScale = myXScale;
+        myScrollYScale = myYScale;
+        myScrollXOffset = myXOffset;
+        myScrollYOffset = myYOffset;
+    }
+    else if( total > myScrollTotal )
+    {
+        // shift previous image left by the whole pixels the samples have moved
+        int shift = t.scrollPixel( total - 1 ) - t.scrollPixel( myScrollTotal - 1 );
+        int width = graph.width();
+        int height = graph.height();
+        if( shift > 0 )
+        {
+            // copy shifted into the spare layer, kept from frame to frame, and swap
+            if( myScrollSpare.size() != graph.size() )
+                myScrollSpare.make( graph.size() );
+            myScrollSpare.bitblt(
+                rectangle( 0, 0, width - shift, height ),
+                myScrollLayer,
+                point( shift, 0 ) );
+            std::swap( myScrollLayer, myScrollSpare );
+        }
+
+        /* Columns holding new samples are redrawn from the background:
+        the column of the last sample already drawn, it may gain more samples,
+        and everything to its right.
+
+        The column of the oldest sample is redrawn too,
+        it may hold part of a line from samples that have now gone.
+
+        Drawing is confined to these columns, so that each is redrawn whole,
+        every trace in turn, exactly as a full redraw would,
+        and only these columns are read into pixel buffers and written back.
+        */
+        int right = std::max( 0, xlast - shift );
+        int left = xlast - ( t.scrollPixel( total - 1 ) - t.scrollPixel( total - w ) );
+        long long first = myScrollTotal - 1;
+        if( left >= right )
+        {
+            // window too narrow to scroll, redraw all
+            right = 0;
+            left = -1;
+            first = total - w;
+        }
+        else
+        {
+            // first sample in the column of the last sample drawn
+            while( first > total - w
+                    && t.scrollPixel( first - 1 ) == t.scrollPixel( myScrollTotal - 1 ) )
+                first--;
+        }
+        myScrollLayer.bitblt(
+            rectangle( right, 0, width - right, height ),
+            myScrollBackground,
+            point( right, 0 ) );
+        if( left >= 0 )
+            myScrollLayer.bitblt(
+                rectangle( 0, 0, left + 1, height ),
+                myScrollBackground,
+                point( 0, 0 ) );
+        long long a = total - w;
+        while( a < total - 1 && t.scrollPixel( a + 1 ) == t.scrollPixel( total - w ) )
+            a++;
+        if( left >= 0 )
+        {
+            rasterizer r( myScrollLayer, 0, left );
+            for( auto rt : myTrace )
+                rt->scrollUpdate( r, total - w, a + 2, xlast );
+            r.paste();
+        }
+
+        // draw from the sample before the redrawn columns to the newest
+        rasterizer r( myScrollLayer, right, width - 1 );
+        for( auto rt : myTrace )
+            rt->scrollUpdate( r, first - 1, total, xlast );
+        r.paste();
+    }
+    myScrollTotal = total;
+
+    graph.bitblt( rectangle( graph.size() ), myScrollLayer );
+    myAxis->update( graph );
+    myAxisX->update( graph );
+    return true;
+}
+
+void plot::DrawStaticLayer( paint::graphics& graph )
+{
+    if( myfStaticLayer
+            && myStaticLayer.size() == graph.size()
+            && myLayerXScale == myXScale
+            && myLayerYScale == myYScale
+            && myLayerXOffset == myXOffset
+            && myLayerYOffset == myYOffset )
+        return;
+
+    // start from the window background
+    myStaticLayer.make( graph.size() );
+    myStaticLayer.bitblt( rectangle( graph.size() ), graph );
+
+    // draw traces that are not realtime
+    rasterizer r( myStaticLayer );
+    for( auto t : myTrace )
+    {
+        if( ! t->live() )
+            t->update( r );
+    }
+    r.paste();
+
+    // draw axis, with labels on top of the traces
+    myAxis->update( myStaticLayer );
+    myAxisX->update( myStaticLayer );
+
+    myfStaticLayer = true;
+    myLayerXScale = myXScale;
+    myLayerYScale = myYScale;
+    myLayerXOffset = myXOffset;
+    myLayerYOffset = myYOffset;
+}
+
+/* Pixel transform kernels
+
+    Each computes px[k] = (int)( offset + scale * v[k] ),
+    truncating towards zero exactly as the implicit conversion in plot::X2Pixel.
+    The multiply and add are kept separate ( no fused multiply-add )
+    so that all kernels give the same pixel as the scalar code.
+*/
+typedef void (*pixel_kernel)( const double* v, int* px, int count, double scale, double offset );
+
+static void pixelsScalar( const double* v, int* px, int count, double scale, double offset )
+{
+    for( int k = 0; k < count; k++ )
+        px[ k ] = offset + scale * v[ k ];
+}
+
+#ifdef NANAPLOT_X86
+
+#ifdef __GNUC__
+__attribute__(( target( "sse2" ) ))
+#endif
+static void pixelsSSE2( const double* v, int* px, int count, double scale, double offset )
+{
+    __m128d s = _mm_set1_pd( scale );
+    __m128d o = _mm_set1_pd( offset );
+    int k = 0;
+    for( ; k + 4 <= count; k += 4 )
+    {
+        __m128i a = _mm_cvttpd_epi32( _mm_add_pd( o, _mm_mul_pd( s, _mm_loadu_pd( v + k ) ) ) );
+        __m128i b = _mm_cvttpd_epi32( _mm_add_pd( o, _mm_mul_pd( s, _mm_loadu_pd( v + k + 2 ) ) ) );
+        _mm_storeu_si128( (__m128i*)( px + k ), _mm_unpacklo_epi64( a, b ) );
+    }
+    pixelsScalar( v + k, px + k, count - k, scale, offset );
+}
+
+#ifdef __GNUC__
+__attribute__(( target( "avx2" ) ))
+#endif
+static void pixelsAVX2( const double* v, int* px, int count, double scale, double offset )
+{
+    __m256d s = _mm256_set1_pd( scale );
+    __m256d o = _mm256_set1_pd( offset );
+    int k = 0;
+    for( ; k + 8 <= count; k += 8 )
+    {
+        __m128i a = _mm256_cvttpd_epi32( _mm256_add_pd( o, _mm256_mul_pd( s, _mm256_loadu_pd( v + k ) ) ) );
+        __m128i b = _mm256_cvttpd_epi32( _mm256_add_pd( o, _mm256_mul_pd( s, _mm256_loadu_pd( v + k + 4 ) ) ) );
+        _mm_storeu_si128( (__m128i*)( px + k ), a );
+        _mm_storeu_si128( (__m128i*)( px + k + 4 ), b );
+    }
+    pixelsSSE2( v + k, px + k, count - k, scale, offset );
+}
+
+/// true if the CPU supports SSE2, always so on x86-64 but not on older 32 bit x86
+static bool hasSSE2()
+{
+#ifdef __GNUC__
+    unsigned a, b, c, d;
+    if( ! __get_cpuid( 1, &a, &b, &c, &d ) )
+        return false;
+    return d & ( 1 << 26 );
+#else
+    int r[ 4 ];
+    __cpuid( r, 1 );
+    return r[ 3 ] & ( 1 << 26 );
+#endif
+}
+
+/// true if the CPU and operating system support AVX2
+static bool hasAVX2()
+{
+#ifdef __GNUC__
+    unsigned a, b, c, d;
+    if( ! __get_cpuid( 1, &a, &b, &c, &d ) )
+        return false;
+    bool osxsave = c & ( 1 << 27 );
+    bool avx = c & ( 1 << 28 );
+    if( ! ( osxsave && avx ) )
+        return false;
+    unsigned xlo, xhi;
+    __asm__( "xgetbv" : "=a"( xlo ), "=d"( xhi ) : "c"( 0 ) );
+    if( ( xlo & 6 ) != 6 )
+        return false;
+    if( __get_cpuid_max( 0, 0 ) < 7 )
+        return false;
+    __cpuid_count( 7, 0, a, b, c, d );
+    return b & ( 1 << 5 );
+#else
+    int r[ 4 ];
+    __cpuid( r, 1 );
+    bool osxsave = r[ 2 ] & ( 1 << 27 );
+    bool avx = r[ 2 ] & ( 1 << 28 );
+    if( ! ( osxsave && avx ) )
+        return false;
+    if( ( _xgetbv( 0 ) & 6 ) != 6 )
+        return false;
+    __cpuid( r, 0 );
+    if( r[ 0 ] < 7 )
+        return false;
+    __cpuidex( r, 7, 0 );
+    return r[ 1 ] & ( 1 << 5 );
+#endif
+}
+
+#endif // NANAPLOT_X86
+
+/// the fastest kernel this CPU can run, chosen once
+static pixel_kernel pixelKernel()
+{
+#ifdef NANAPLOT_X86
+    static const pixel_kernel kernel =
+        hasAVX2() ? pixelsAVX2 : hasSSE2() ? pixelsSSE2 : pixelsScalar;
+#else
+    static const pixel_kernel kernel = pixelsScalar;
+#endif
+    return kernel;
+}
+
+void plot::X2Pixel( const double* x, int* px, int count ) const
+{
+    pixelKernel()( x, px, count, myXScale, myXOffset );
+}
+
+void plot::Y2Pixel( const double* y, int* px, int count ) const
+{
+    pixelKernel()( y, px, count, -myYScale, myYOffset );
+}
+
+void plot::CalcScale( int w, int h )
+{
+    w *= 0.9;
+    h *= 0.95;
+
+    // bounds of all the traces that hold data
+    bool fData = false;
+    for( auto& t : myTrace )
+    {
+        double txmin, txmax, tymin, tymax;
+        if( ! t->bounds( txmin, txmax, tymin, tymax ) )
+            continue;
+        if( ! fData )
+        {
+            myMinX = txmin;
+            myMaxX = txmax;
+            myMinY = tymin;
+            myMaxY = tymax;
+            fData = true;
+        }
+        if( txmin < myMinX )
+            myMinX = txmin;
+        if( txmax > myMaxX )
+            myMaxX = txmax;
+        if( tymin < myMinY )
+            myMinY = tymin;
+        if( tymax > myMaxY )
+            myMaxY = tymax;
+    }
+    if( ! fData )
+        return;
+    // a flat data range is drawn at scale 1,
+    // a range the application or the user chose is fitted to the window unless empty
+    bool fFlatX = ! myfView && flatRange( myMinX, myMaxX );
+    bool fFlatY = myfView ? false
+                  : myfFixedY ? ! ( myFixedMinY < myFixedMaxY )
+                  : flatRange( myMinY, myMaxY );
+    if( myfView )
+    {
+        myMinX = myViewMinX;
+        myMaxX = myViewMaxX;
+        myMinY = myViewMinY;
+        myMaxY = myViewMaxY;
+    }
+    else if( myfFixedY )
+    {
+        myMinY = myFixedMinY;
+        myMaxY = myFixedMaxY;
+    }
+    if( fFlatX )
+        myXScale = 1;
+    else
+        myXScale = 0.9 * w / ( myMaxX - myMinX );
+    if( fFlatY )
+        myYScale = 1;
+    else
+        myYScale = 0.9 * h / ( myMaxY - myMinY );
+
+    myXOffset = 0.05 * w - myXScale * myMinX;
+    myYOffset = h - 10 + myYScale * myMinY;
+
+    //std::cout << myMinY <<" "<< myMaxY <<" "<< myScale;
+}
+void trace::set( const std::vector< double >& y )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+
+    // find the range of data that has changed
+    long long first = 0;
+    long long common = std::min( mySeries.size(), (long long)y.size() );
+    while( first < common && mySeries[ first ] == y[ first ] )
+        first++;
+    long long last = y.size();
+    if( mySeries.size() == (long long)y.size() )
+        while( last > first && mySeries[ last-1 ] == y[ last-1 ] )
+            last--;
+
+    // a new length changes the block holding the last sample, even when it is a prefix
+    if( mySeries.size() != (long long)y.size() && y.size() )
+        first = std::min( first, ( last - 1 ) / pyramid::BLOCK * pyramid::BLOCK );
+
+    myY = y;
+    mySeries.view( myY.data(), myY.size() );
+    myXSeries.clear();
+    myFile.reset();
+    mySummary.reset();
+    myCoarse.clear();
+
+    // update summaries of the changed range only
+    if( myfSummarized )
+        myPyramid.update( mySeries, first, last );
+    myPlot->LayersChanged();
+
+    std::cout << "plot::trace::set " << myY.size() << "\n";
+}
+template< class T >
+void trace::own(
+    const std::vector< T >& y,
+    series::eValue value,
+    double scale, double offset )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+    std::shared_ptr< std::vector< T > > data( new std::vector< T >( y ) );
+    series s;
+    s.view( data->data(), value, data->size(), 1, data );
+    s.transform( scale, offset );
+    replace( s, series() );
+}
+
+void trace::set( const std::vector< float >& y, double scale, double offset )
+{
+    own( y, series::eValue::f32, scale, offset );
+}
+void trace::set( const std::vector< int32_t >& y, double scale, double offset )
+{
+    own( y, series::eValue::i32, scale, offset );
+}
+void trace::set( const std::vector< int16_t >& y, double scale, double offset )
+{
+    own( y, series::eValue::i16, scale, offset );
+}
+
+void trace::extend( const double * y, long long count )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+    if( mySeries.size() != (long long)myY.size() || myXSeries.size() )
+        throw std::runtime_error("nanaplot error: plot data added to view of application data");
+    if( count <= 0 )
+        return;
+
+    long long first = myY.size();
+    myY.insert( myY.end(), y, y + count );
+    mySeries.view( myY.data(), myY.size() );
+    if( myfSummarized )
+        myPyramid.update( mySeries, first, myY.size() );
+    myPlot->LayersChanged();
+}
+
+void trace::view( const double * y, long long count, int stride )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+    series s;
+    s.view( y, count, stride );
+    replace( s, series() );
+}
+
+void trace::view( std::shared_ptr< const double > y, long long count, int stride )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+    series s;
+    s.view( y.get(), count, stride, y );
+    replace( s, series() );
+}
+
+template< class T >
+void trace::viewAs(
+    const T * y,
+    series::eValue value,
+    long long count, int stride,
+    double scale, double offset )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+    series s;
+    s.view( y, value, count, stride );
+    s.transform( scale, offset );
+    replace( s, series() );
+}
+
+void trace::view( const float * y, long long count, int stride, double scale, double offset )
+{
+    viewAs( y, series::eValue::f32, count, stride, scale, offset );
+}
+void trace::view( const int32_t * y, long long count, int stride, double scale, double offset )
+{
+    viewAs( y, series::eValue::i32, count, stride, scale, offset );
+}
+void trace::view( const int16_t * y, long long count, int stride, double scale, double offset )
+{
+    viewAs( y, series::eValue::i16, count, stride, scale, offset );
+}
+
+void trace::load( const std::string& path, eFile format, double scale, double offset )
+{
+    if( myType != eType::plot )
+        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+
+    // the file holds little-endian values, which are read in place
+    const unsigned one = 1;
+    if( ! *reinterpret_cast< const char * >( &one ) )
+        throw std::runtime_error("nanaplot error: binary files need a little-endian host");
+
+    std::shared_ptr< mapped_file > file( new mapped_file( path ) );
+
+    series::eValue value = series::eValue::f64;
+    int size = 8;
+    switch( format )
+    {
+    case eFile::float32:
+    case eFile::xy_float32:
+        value = series::eValue::f32;
+        size = 4;
+        break;
+    case eFile::int32:
+        value = series::eValue::i32;
+        size = 4;
+        break;
+    case eFile::int16:
+        value = series::eValue::i16;
+        size = 2;
+        break;
+    default:
+        break;
+    }
+    series y, x;
+    if( format == eFile::xy_float32 || format == eFile::xy_float64 )
+    {
+        long long count = file->size() / ( 2 * size );
+        x.view( file->data(), value, count, 2, file );
+        y.view( file->data() + size, value, count, 2, file );
+    }
+    else
+    {
+        y.view( file->data(), value, file->size() / size, 1, file );
+    }
+    y.transform( scale, offset );
+    replace( y, x );
+    myFile = file;
+}
+
+void trace::replace( const series& y, const series& x )
+{
+    myY.clear();
+    myY.shrink_to_fit();
+    myFile.reset();
+    mySeries = y;
+    myXSeries = x;
+    myPyramid.clear();
+    mySummary.reset();
+    myCoarse.clear();
+    myfSummarized = false;
+    myPlot->LayersChanged();
+}
+
+void trace::summarize()
+{
+    if( myfSummarized || mySummary )
+        return;
+    if( myFile )
+    {
+        // reading the whole file would freeze the GUI, draw coarse bins until the worker is done
+        mySummary.reset( new summary_worker( mySeries, myXSeries, myFile ) );
+        myPlot->StartFrameTimer();
+        return;
+    }
+    myPyramid.update( mySeries, 0, mySeries.size() );
+    myfSummarized = true;
+}
+
+void trace::changed( long long first, long long last )
+{
+    if( myType != eType::plot )
+        return;
+    myPlot->LayersChanged();
+    if( ! myfSummarized )
+        return;
+    first = std::max( first, 0LL );
+    last = std::min( last, mySeries.size() );
+    myPyramid.update( mySeries, first, last );
+}
+
+void trace::add( double y )
+{
+    if( myType == eType::histogram )
+    {
+        appendHistogram( &y, 1 );
+        myPlot->update();
+        return;
+    }
+    if( myType != eType::realtime )
+        throw std::runtime_error("nanaplot error: realtime data added to non realtime trace");
+    if( myRing->channels() != 1 )
+        throw std::runtime_error("nanaplot error: realtime data added to one trace of a realtime group");
+    append( y );
+
+    myPlot->update();
+}
+
+void trace::append( double y )
+{
+    myRing->push( &y, 1 );
+    myWindowBounds.push( y );
+    feed( &y, 1, 1 );
+}
+
+void trace::add( const double * y, int count )
+{
+    if( myType == eType::histogram )
+    {
+        appendHistogram( y, count );
+        myPlot->update();
+        return;
+    }
+    if( myType != eType::realtime )
+        throw std::runtime_error("nanaplot error: realtime data added to non realtime trace");
+    if( myRing->channels() != 1 )
+        throw std::runtime_error("nanaplot error: realtime data added to one trace of a realtime group");
+    append( y, count );
+
+    myPlot->update();
+}
+
+void trace::append( const double * y, int count )
+{
+    if( count <= 0 )
+        return;
+    myRing->push( y, count );
+    myWindowBounds.push( y, count );
+    feed( y, count, 1 );
+}
+
+void trace::feed( const double * y, int count, int stride )
+{
+    if( myHistory )
+        myHistory->push( y, count, stride );
+    for( auto& s : mySpectra )
+        s->push( y, count, stride );
+}
+
+void trace::pushBounds( int count )
+{
+    // samples that left the window before being seen cannot affect the bounds
+    int w = myRing->width();
+    int n = std::min( count, w );
+    const double * y = myRing->channel( myChannel );
+    int start = ( myRing->next() - n + w ) % w;
+    int tail = std::min( n, w - start );
+    myWindowBounds.push( y + start, tail );
+    myWindowBounds.push( y, n - tail );
+}
+
+void trace::history( long long samples )
+{
+    if( myType != eType::realtime )
+        throw std::runtime_error("nanaplot error: history for non realtime trace");
+    if( samples <= 0 )
+    {
+        myHistory.reset();
+        return;
+    }
+    myHistory.reset( new history_store( samples ) );
+    myHistoryOrigin = myRing->total();
+}
+
+void trace::history( long long samples, const std::string& path, long long memory )
+{
+    if( myType != eType::realtime )
+        throw std::runtime_error("nanaplot error: history for non realtime trace");
+    if( samples <= 0 )
+    {
+        myHistory.reset();
+        return;
+    }
+    std::unique_ptr< history_store > h( new history_store( samples ) );
+    h->spill( path, memory );
+    myHistory = std::move( h );
+
+    // recovered samples come before the samples in the display window
+    myHistoryOrigin = myRing->total() - myHistory->total();
+}
+
+std::vector< double > trace::historyExport( long long first, long long count ) const
+{
+    std::vector< double > y;
+    if( ! myHistory || first < 0 )
+        return y;
+    first += myHistory->first();
+    long long last = std::min( myHistory->total(), first + count );
+    if( first >= last )
+        return y;
+    y.resize( last - first );
+    myHistory->read( first, last, y.data() );
+    return y;
+}
+
+void trace::queue( int capacity )
+{
+    if( myType != eType::realtime )
+        throw std::runtime_error("nanaplot error: queue for non realtime trace");
+    if( myRing->channels() != 1 )
+        throw std::runtime_error("nanaplot error: queue for one trace of a realtime group");
+    myQueue.reset( new ingest_queue( capacity ) );
+}
+
+bool trace::drain()
+{
+    if( mySummary )
+    {
+        if( ! mySummary->acquire( myCoarse ) )
+            return false;
+        if( mySummary->ready() )
+        {
+            mySummary->take( myPyramid );
+            mySummary.reset();
+            myCoarse.clear();
+            myfSummarized = true;
+        }
+        myPlot->LayersChanged();
+        return true;
+    }
+    if( mySpectrum )
+        return mySpectrum->acquire();
+    if( ! myQueue )
+        return false;
+
+    // take the samples in batches
+    // no more than the queue holds, so producers cannot keep us here
+    double batch[ 1024 ];
+    int total = 0;
+    while( total < myQueue->capacity() )
+    {
+        int count = myQueue->pop( batch, 1024 );
+        if( ! count )
+            break;
+        append( batch, count );
+        total += count;
+    }
+    return total > 0;
+}
+
+ingest_queue::ingest_queue( int capacity )
+    : myEnqueue( 0 )
+    , myDequeue( 0 )
+    , myDropped( 0 )
+{
+    size_t size = 2;
+    while( (int)size < capacity )
+        size *= 2;
+    myCells = std::vector< cell >( size );
+    for( size_t k = 0; k < size; k++ )
+        myCells[ k ].sequence.store( k, std::memory_order_relaxed );
+    myMask = size - 1;
+}
+
+bool ingest_queue::push( double y )
+{
+    cell * c;
+    size_t pos = myEnqueue.load( std::memory_order_relaxed );
+    for( ;; )
+    {
+        c = &myCells[ pos & myMask ];
+        size_t seq = c->sequence.load( std::memory_order_acquire );
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if( diff == 0 )
+        {
+            // cell is free, try to claim it
+            if( myEnqueue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                break;
+        }
+        else if( diff < 0 )
+        {
+            // consumer has not yet emptied this cell
+            myDropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        else
+        {
+            // another producer claimed this cell
+            pos = myEnqueue.load( std::memory_order_relaxed );
+        }
+    }
+    c->value = y;
+    c->sequence.store( pos + 1, std::memory_order_release );
+    return true;
+}
+
+int ingest_queue::pop( double * y, int max )
+{
+    int count = 0;
+    while( count < max )
+    {
+        cell& c = myCells[ myDequeue & myMask ];
+        size_t seq = c.sequence.load( std::memory_order_acquire );
+        if( (intptr_t)seq - (intptr_t)( myDequeue + 1 ) < 0 )
+            break;
+        y[ count++ ] = c.value;
+
+        // free the cell for the producer one lap ahead
+        c.sequence.store( myDequeue + myMask + 1, std::memory_order_release );
+        myDequeue++;
+    }
+    return count;
+}
+
+void trace::add( double x, double y )
+{
+    if( myType == eType::timed )
+    {
+        appendTimed( x, y );
+        myPlot->update();
+        return;
+    }
+    if( myType != eType::scatter )
+        throw std::runtime_error("nanaplot error: point data added to non scatter type trace");
+    if( ! myY.size() )
+    {
+        myXMin = myXMax = x;
+        myYMin = myYMax = y;
+    }
+    myXMin = std::min( myXMin, x );
+    myXMax = std::max( myXMax, x );
+    myYMin = std::min( myYMin, y );
+    myYMax = std::max( myYMax, y );
+    myX.push_back( x );
+    myY.push_back( y );
+    myPlot->LayersChanged();
+}
+
+void trace::appendTimed( double t, double y )
+{
+    if( myY.size() > myTimedFirst && t < myX.back() )
+        throw std::runtime_error("nanaplot error: timed trace sample earlier than previous sample");
+    myX.push_back( t );
+    myY.push_back( y );
+    myWindowBounds.push( y );
+
+    // discard samples that have left the time window
+    size_t first = myTimedFirst;
+    while( myX[ myTimedFirst ] < t - myDuration )
+        myTimedFirst++;
+    myTimedDropped += myTimedFirst - first;
+    myWindowBounds.expire( myTimedDropped );
+
+    // reclaim space once most of the storage is discarded samples,
+    // moving each sample at most once for every sample added
+    if( myTimedFirst > 1024 && myTimedFirst * 2 > myX.size() )
+    {
+        myX.erase( myX.begin(), myX.begin() + myTimedFirst );
+        myY.erase( myY.begin(), myY.begin() + myTimedFirst );
+        myTimedFirst = 0;
+    }
+}
+
+/// colours from dark blue through green to yellow
+static std::vector< unsigned > makeColourRamp()
+{
+    static const unsigned char stop[ 5 ][ 3 ] =
+    {
+        {  68,   1,  84 },
+        {  59,  82, 139 },
+        {  33, 145, 140 },
+        {  94, 201,  98 },
+        { 253, 231,  37 }
+    };
+    std::vector< unsigned > ramp( 256 );
+    for( int k = 0; k < 256; k++ )
+    {
+        double f = k / 255.0 * 4;
+        int s = std::min( (int)f, 3 );
+        f -= s;
+        unsigned rgb[ 3 ];
+        for( int c = 0; c < 3; c++ )
+            rgb[ c ] = stop[ s ][ c ] + f * ( stop[ s+1 ][ c ] - stop[ s ][ c ] ) + 0.5;
+        ramp[ k ] = nana::color( rgb[ 0 ], rgb[ 1 ], rgb[ 2 ] ).px_color().value;
+    }
+    return ramp;
+}
+
+/// 256 pixel colours from dark blue through green to yellow, built on first use
+static const unsigned * colourRamp()
+{
+    static const std::vector< unsigned > ramp = makeColourRamp();
+    return ramp.data();
+}
+
+void trace::histogram( double min, double max, int bins, bool expand )
+{
+    myType = eType::histogram;
+    myfExpand = expand;
+
+    // expanding merges pairs of bins
+    if( expand && bins % 2 )
+        bins++;
+    myBin.assign( bins, 0 );
+    myBinMin = min;
+    myBinWidth = ( max - min ) / bins;
+    myWeight = 1;
+    myDecay = 1;
+    myOutside = 0;
+}
+
+void trace::decay( double halfLife )
+{
+    if( myType != eType::histogram )
+        throw std::runtime_error("nanaplot error: decay for non histogram trace");
+
+    // bring counts up to date with weight 1, then change the rate
+    for( auto& b : myBin )
+        b /= myWeight;
+    myWeight = 1;
+    myDecay = halfLife > 0 ? pow( 0.5, 1 / halfLife ) : 1;
+}
+
+void trace::appendHistogram( const double * y, int count )
+{
+    int n = myBin.size();
+    for( int k = 0; k < count; k++ )
+    {
+        double v = y[ k ];
+        double i = floor( ( v - myBinMin ) / myBinWidth );
+        if( ! ( 0 <= i && i < n ) )
+        {
+            if( ! myfExpand || ! std::isfinite( v ) )
+            {
+                myOutside++;
+                continue;
+            }
+            expandBins( v );
+            i = std::min( n - 1.0, std::max( 0.0, floor( ( v - myBinMin ) / myBinWidth ) ) );
+        }
+
+        /* Rather than scale every bin down as each sample arrives
+        each sample is weighted more than the one before.
+        The count shown is the bin divided by the weight of the newest sample.
+        */
+        myWeight /= myDecay;
+        myBin[ (int)i ] += myWeight;
+        if( myWeight > 1e100 )
+        {
+            for( auto& b : myBin )
+                b /= myWeight;
+            myWeight = 1;
+        }
+    }
+}
+
+void trace::expandBins( double y )
+{
+    int n = myBin.size();
+    std::vector< double > merged( n );
+    while( y < myBinMin || y >= myBinMin + n * myBinWidth )
+    {
+        // extend by the width of all the bins on the side of the sample
+        int shift = y < myBinMin ? n : 0;
+        if( shift )
+            myBinMin -= n * myBinWidth;
+        myBinWidth *= 2;
+        std::fill( merged.begin(), merged.end(), 0 );
+        for( int k = 0; k < n; k++ )
+            merged[ ( shift + k ) / 2 ] += myBin[ k ];
+        myBin.swap( merged );
+    }
+}
+
+void trace::waterfall( int columns, int rows, double min, double max )
+{
+    myType = eType::waterfall;
+    myColumns = columns;
+    myRows = rows;
+    myRowNext = 0;
+    myRowTotal = 0;
+    myCellMin = min;
+    myCellMax = max;
+    myCells.assign( (size_t)columns * rows, 0 );
+    myImage.assign( (size_t)columns * rows, 0 );
+}
+
+void trace::addRow( const float * values )
+{
+    if( myType != eType::waterfall )
+        throw std::runtime_error("nanaplot error: row added to non waterfall trace");
+    std::copy( values, values + myColumns, myCells.begin() + (size_t)myRowNext * myColumns );
+    mapRow();
+    myPlot->update();
+}
+
+void trace::addRow( const double * values )
+{
+    if( myType != eType::waterfall )
+        throw std::runtime_error("nanaplot error: row added to non waterfall trace");
+    std::copy( values, values + myColumns, myCells.begin() + (size_t)myRowNext * myColumns );
+    mapRow();
+    myPlot->update();
+}
+
+void trace::mapRow()
+{
+    const unsigned * ramp = colourRamp();
+    const float * v = myCells.data() + (size_t)myRowNext * myColumns;
+    unsigned * px = myImage.data() + (size_t)myRowNext * myColumns;
+    double scale = 255 / ( myCellMax - myCellMin );
+    for( int c = 0; c < myColumns; c++ )
+    {
+        double f = ( v[ c ] - myCellMin ) * scale;
+        px[ c ] = ramp[ f > 0 ? (int)std::min( f, 255.0 ) : 0 ];
+    }
+
+    // scroll by moving the start of the ring
+    myRowNext = ( myRowNext + 1 ) % myRows;
+    myRowTotal++;
+}
+
+void trace::image( rasterizer& graph )
+{
+    // cell under the centre of each pixel column
+    int left = std::max( 0, myPlot->X2Pixel( 0 ) );
+    int right = std::min( graph.width(), myPlot->X2Pixel( myColumns ) + 1 );
+    std::vector< int > cell;
+    for( int x = left; x < right; x++ )
+    {
+        double c = floor( ( myPlot->Pixel2X( x ) + myPlot->Pixel2X( x + 1 ) ) / 2 );
+        if( c < 0 || c >= myColumns )
+        {
+            if( cell.empty() )
+            {
+                left++;
+                continue;
+            }
+            break;
+        }
+        cell.push_back( c );
+    }
+    if( cell.empty() )
+        return;
+
+    int top = std::max( 0, myPlot->Y2Pixel( myRows ) );
+    int bottom = std::min( graph.height(), myPlot->Y2Pixel( 0 ) + 1 );
+    for( int y = top; y < bottom; y++ )
+    {
+        // rows counted up from the oldest, the newest is at the top
+        double r = floor( ( myPlot->Pixel2Y( y ) + myPlot->Pixel2Y( y + 1 ) ) / 2 );
+        if( r < 0 || r >= myRows )
+            continue;
+        int age = myRows - 1 - (int)r;
+        if( age >= myRowTotal )
+            continue;
+        const unsigned * src = myImage.data()
+                               + (size_t)( ( myRowNext - 1 - age + myRows ) % myRows ) * myColumns;
+        pixel_argb_t * dst = graph.row( y ) + left;
+        for( int k = 0; k < (int)cell.size(); k++ )
+            dst[ k ].value = src[ cell[ k ] ];
+    }
 }
 
-trace& plot::AddScatterTrace()
+void trace::bars( rasterizer& graph )
 {
-    trace * t = new trace();
-    t->Plot( this );
-    t->scatter();
-    myTrace.push_back( t );
-    return *t;
+    int bottom = myPlot->Y2Pixel( 0 );
+    for( int k = 0; k < (int)myBin.size(); k++ )
+    {
+        if( ! myBin[ k ] )
+            continue;
+        int left = myPlot->X2Pixel( myBinMin + k * myBinWidth );
+        int right = myPlot->X2Pixel( myBinMin + ( k + 1 ) * myBinWidth );
+        int top = myPlot->Y2Pixel( myBin[ k ] / myWeight );
+
+        // gap between bars wide enough to show one
+        int width = right - left > 3 ? right - left - 1 : std::max( 1, right - left );
+        graph.fill( rectangle( left, top, width, bottom - top + 1 ), myColor );
+    }
 }
 
-void plot::RegisterDrawingFunction()
+void trace::add( const double * x, const double * y, int count )
 {
-    /* The drawing object is just defined as a local variable
+    if( myType != eType::scatter )
+        throw std::runtime_error("nanaplot error: point data added to non scatter type trace");
+    if( count <= 0 )
+        return;
+    auto rx = std::minmax_element( x, x + count );
+    auto ry = std::minmax_element( y, y + count );
+    if( ! myY.size() )
+    {
+        myXMin = *rx.first;
+        myXMax = *rx.second;
+        myYMin = *ry.first;
+        myYMax = *ry.second;
+    }
+    myXMin = std::min( myXMin, *rx.first );
+    myXMax = std::max( myXMax, *rx.second );
+    myYMin = std::min( myYMin, *ry.first );
+    myYMax = std::max( myYMax, *ry.second );
+    myX.insert( myX.end(), x, x + count );
+    myY.insert( myY.end(), y, y + count );
+    myPlot->LayersChanged();
+}
 
-    When the drawing object gets destroyed, the drawer functions are still alive.
-    The drawing object doesn't manage the life-time of drawer functions,
-    it is just for installing drawer functions.
+void trace::color( const colors & clr )
+{
+    myColor = clr;
+    myPlot->LayersChanged();
+}
 
-    */
-    drawing( myParent ).draw([this](paint::graphics& graph)
+bool trace::bounds(
+    double& txmin, double& txmax,
+    double& tymin, double& tymax )
+{
+    if( ! size() )
+        return false;
+
+    switch( myType )
     {
-        // check there are traces that need to be drawn
-        if( ! myTrace.size() )
+    case eType::plot:
+        summarize();
+        if( myXSeries.size() )
+        {
+            txmin = myXSeries[ 0 ];
+            txmax = myXSeries[ myXSeries.size() - 1 ];
+        }
+        else
+        {
+            txmin = 0;
+            txmax = mySeries.size();
+        }
+        if( ! myfSummarized )
+        {
+            // summary still being built, bounds of the bins so far
+            if( myCoarse.empty() )
+                return false;
+            tymin = myCoarse[ 0 ].min;
+            tymax = myCoarse[ 0 ].max;
+            for( auto& k : myCoarse )
+            {
+                tymin = std::min( tymin, k.min );
+                tymax = std::max( tymax, k.max );
+            }
+            break;
+        }
+        myPyramid.bounds( tymin, tymax );
+        break;
+
+    case eType::realtime:
+        txmin = 0;
+        txmax = myRing->width();
+        tymin = myWindowBounds.min();
+        tymax = myWindowBounds.max();
+        break;
+
+    case eType::scatter:
+        txmin = myXMin;
+        txmax = myXMax;
+        tymin = myYMin;
+        tymax = myYMax;
+        break;
+
+    case eType::spectrum:
+        txmin = 0;
+        txmax = ( mySpectrum->spectrum().size() - 1 ) * myBinScale;
+        tymin = mySpectrum->min();
+        tymax = mySpectrum->max();
+        break;
+
+    case eType::waterfall:
+        txmin = 0;
+        txmax = myColumns;
+        tymin = 0;
+        tymax = myRows;
+        break;
+
+    case eType::histogram:
+        txmin = myBinMin;
+        txmax = myBinMin + myBin.size() * myBinWidth;
+        tymin = 0;
+        tymax = *std::max_element( myBin.begin(), myBin.end() ) / myWeight;
+        break;
+
+    case eType::timed:
+        txmax = myX.back();
+        txmin = txmax - myDuration;
+        tymin = myWindowBounds.min();
+        tymax = myWindowBounds.max();
+        break;
+    }
+    return true;
+}
+
+void sliding_bounds::push( double y )
+{
+    // drop candidates that can never again be the min or max
+    while( myMin.size() && myMin.back().second >= y )
+        myMin.pop_back();
+    while( myMax.size() && myMax.back().second <= y )
+        myMax.pop_back();
+    myMin.push_back( std::make_pair( myCount, y ) );
+    myMax.push_back( std::make_pair( myCount, y ) );
+
+    // drop candidates that have left the window
+    myCount++;
+    while( myMin.front().first <= myCount - 1 - myWidth )
+        myMin.pop_front();
+    while( myMax.front().first <= myCount - 1 - myWidth )
+        myMax.pop_front();
+}
+
+void sliding_bounds::push( const double * y, int count )
+{
+    // samples that will leave the window within this batch need not be seen
+    if( count > myWidth )
+    {
+        myCount += count - myWidth;
+        myMin.clear();
+        myMax.clear();
+        y += count - myWidth;
+        count = myWidth;
+    }
+    for( int k = 0; k < count; k++ )
+        push( y[ k ] );
+}
+
+void sliding_bounds::expire( long long first )
+{
+    while( myMin.size() && myMin.front().first < first )
+        myMin.pop_front();
+    while( myMax.size() && myMax.front().first < first )
+        myMax.pop_front();
+}
+
+/** \brief Reduce a run of samples to the pixel columns they land in
+
+    Every sample that falls into the same pixel column is drawn
+    on the same vertical line, so only the first, lowest, highest
+    and last pixel of each column contribute to the image.
+    The line through first, min, max and last of each column
+    covers exactly the same pixels as the line through every sample,
+    so the drawing cost depends on the plot width, not the data size.
+*/
+class envelope
+{
+public:
+    envelope( std::vector< point >& line )
+        : myLine( line )
+        , myfEmpty( true )
+    {
+        myLine.clear();
+    }
+
+    /// add next sample, in pixel co-ordinates
+    void add( int x, int y )
+    {
+        if( myfEmpty || x != myX )
+        {
+            flush();
+            myfEmpty = false;
+            myX     = x;
+            myFirst = myMin = myMax = myLast = y;
+            return;
+        }
+        if( y < myMin )
+            myMin = y;
+        if( y > myMax )
+            myMax = y;
+        myLast = y;
+    }
+
+    /// add the column in progress to the line
+    void flush()
+    {
+        if( myfEmpty )
+            return;
+        push( myFirst );
+        if( myFirst != myMin && myLast != myMin )
+            push( myMin );
+        if( myFirst != myMax && myLast != myMax )
+            push( myMax );
+        push( myLast );
+        myfEmpty = true;
+    }
+
+private:
+    std::vector< point >& myLine;
+    bool myfEmpty;
+    int myX;
+    int myFirst, myMin, myMax, myLast;
+
+    void push( int y )
+    {
+        point p( myX, y );
+        if( myLine.size() && myLine.back() == p )
             return;
+        myLine.push_back( p );
+    }
+};
+
+void trace::update( rasterizer& graph )
+{
+    switch( myType )
+    {
+    case eType::plot:
+    {
+        // reduce data points to pixel column envelope
+        summarize();
+        envelope env( myLine );
+        long long n = mySeries.size();
+        if( ! n )
+            break;
+
+        if( ! myfSummarized )
+        {
+            // summary of a mapped file still being built, draw its bins in view
+            double xleft = myPlot->Pixel2X( 0 );
+            double xright = myPlot->Pixel2X( graph.width() );
+            for( size_t k = 0; k < myCoarse.size(); k++ )
+            {
+                if( k + 1 < myCoarse.size() && myCoarse[ k + 1 ].x < xleft )
+                    continue;
+                if( k && myCoarse[ k - 1 ].x > xright )
+                    break;
+                myXBuf.push_back( myCoarse[ k ].x );
+                myYBuf.push_back( myCoarse[ k ].min );
+                myXBuf.push_back( myCoarse[ k ].x );
+                myYBuf.push_back( myCoarse[ k ].max );
+            }
+            pixels();
+            for( int k = 0; k < (int)myXPx.size(); k++ )
+                env.add( myXPx[ k ], myYPx[ k ] );
+            env.flush();
+            polyline( graph );
+            break;
+        }
+
+        // samples in view, plus one either side to draw lines to the edges
+        long long first = std::max( 0LL, firstSampleAt( 0 ) - 1 );
+        long long last = std::min( n, firstSampleAt( graph.width() ) + 1 );
+        if( first >= last )
+            break;
+
+        if( last - first <= 2 * (long long)graph.width() )
+        {
+            for( long long xi = first; xi < last; xi++ )
+            {
+                myXBuf.push_back( X( xi ) );
+                myYBuf.push_back( mySeries[ xi ] );
+            }
+            pixels();
+            for( int k = 0; k < (int)myXPx.size(); k++ )
+                env.add( myXPx[ k ], myYPx[ k ] );
+        }
+        else
+        {
+            // many samples per column
+            // read first and last sample of each column
+            // and find min and max from the summaries
+            int lastpx = myPlot->X2Pixel( X( last-1 ) );
+            long long b = first;
+            std::vector< int > columns;
+            while( b < last )
+            {
+                // skip straight to the column of the next sample
+                long long a = b;
+                int px = myPlot->X2Pixel( X( a ) );
+                b = ( px >= lastpx ) ? last : std::max( a + 1, firstSampleAt( px+1 ) );
+                double mn, mx;
+                myPyramid.range( mySeries, a, b, mn, mx );
+                columns.push_back( px );
+                myYBuf.push_back( mySeries[ a ] );
+                myYBuf.push_back( mn );
+                myYBuf.push_back( mx );
+                myYBuf.push_back( mySeries[ b-1 ] );
+            }
+            pixels();
+            for( int k = 0; k < (int)columns.size(); k++ )
+                for( int j = 4 * k; j < 4 * k + 4; j++ )
+                    env.add( columns[ k ], myYPx[ j ] );
+        }
+        env.flush();
+
+        polyline( graph );
+    }
+    break;
+
+    case eType::scatter:
+
+        if( (long long)myX.size() > myDensityThreshold )
+        {
+            heatmap( graph );
+            break;
+        }
+        myXBuf = myX;
+        myYBuf = myY;
+        pixels();
+        for( int k = 0; k < (int)myXPx.size(); k++ )
+        {
+            graph.frame(
+                rectangle{ myXPx[ k ]-5,  myYPx[ k ]-5,
+                           10, 10 },
+                myColor );
+        }
+        break;
+
+    case eType::realtime:
+
+    {
+        // loop over data points
+
+        // they are stored in a circular buffer
+        // so we have to start with the oldest data point
+        envelope env( myLine );
+        // history is shown only when the view is moved off the display window
+        if( myHistory && myPlot->myfView )
+            drawHistory( graph, 0 );
+
+        int w = myRing->width();
+        const double * y = myRing->channel( myChannel );
+        myYBuf.assign( y + myRing->next(), y + w );
+        myYBuf.insert( myYBuf.end(), y, y + myRing->next() );
+        for( int xi = 0; xi < w; xi++ )
+            myXBuf.push_back( xi );
+        pixels();
+        for( int k = 0; k < (int)myXPx.size(); k++ )
+            env.add( myXPx[ k ], myYPx[ k ] );
+        env.flush();
+
+        polyline( graph );
+    }
+    break;
+
+    case eType::timed:
+    {
+        // samples in the window, in chunks so the buffers stay small
+        envelope env( myLine );
+        const int CHUNK = 4096;
+        for( size_t a = myTimedFirst; a < myY.size(); a += CHUNK )
+        {
+            size_t b = std::min( myY.size(), a + CHUNK );
+            myXBuf.assign( myX.begin() + a, myX.begin() + b );
+            myYBuf.assign( myY.begin() + a, myY.begin() + b );
+            pixels();
+            for( int k = 0; k < (int)myXPx.size(); k++ )
+                env.add( myXPx[ k ], myYPx[ k ] );
+        }
+        env.flush();
+
+        polyline( graph );
+    }
+    break;
+
+    case eType::histogram:
+        bars( graph );
+        break;
+
+    case eType::waterfall:
+        image( graph );
+        break;
+
+    case eType::spectrum:
+    {
+        // the spectrum taken when the plot last drained, transformed where it is
+        envelope env( myLine );
+        const std::vector< double >& y = mySpectrum->spectrum();
+        for( int k = 0; k < (int)y.size(); k++ )
+            myXBuf.push_back( k * myBinScale );
+        pixels();
+        myYPx.resize( y.size() );
+        myPlot->Y2Pixel( y.data(), myYPx.data(), y.size() );
+        for( int k = 0; k < (int)myXPx.size(); k++ )
+            env.add( myXPx[ k ], myYPx[ k ] );
+        env.flush();
+
+        polyline( graph );
+    }
+    break;
+    }
+}
+
+void trace::drawHistory( rasterizer& graph, int left )
+{
+    // frame drawn at x = 0, and first and last frames in history
+    long long base = myRing->total() - myRing->width();
+    long long hfirst = myHistoryOrigin + myHistory->first();
+    long long hlast = myHistoryOrigin + myHistory->total();
+
+    // frame at a pixel column, from the inverse of plot::X2Pixel then corrected for rounding
+    auto frameAt = [&]( int px )
+    {
+        double x = ceil( myPlot->Pixel2X( px ) );
+        long long f = std::max( (double)hfirst, std::min( x + base, (double)hlast ) );
+        while( f > hfirst && myPlot->X2Pixel( (double)( f - 1 - base ) ) >= px )
+            f--;
+        while( f < hlast && myPlot->X2Pixel( (double)( f - base ) ) < px )
+            f++;
+        return f;
+    };
+
+    // frames in view left of the ring, joined to the oldest frame in the ring
+    long long first = std::max( hfirst, frameAt( left ) - 1 );
+    long long last = std::min( std::min( hlast, base + 1 ), frameAt( graph.width() ) + 1 );
+    if( first >= last )
+        return;
+
+    envelope env( myLine );
+    if( last - first <= 2 * (long long)graph.width() )
+    {
+        for( long long f = first; f < last; f++ )
+        {
+            myXBuf.push_back( f - base );
+            myYBuf.push_back( myHistory->at( f - myHistoryOrigin ) );
+        }
+        pixels();
+        for( int k = 0; k < (int)myXPx.size(); k++ )
+            env.add( myXPx[ k ], myYPx[ k ] );
+    }
+    else
+    {
+        // many frames per column, min and max from the block summaries
+        int lastpx = myPlot->X2Pixel( (double)( last - 1 - base ) );
+        long long b = first;
+        std::vector< int > columns;
+        while( b < last )
+        {
+            long long a = b;
+            int px = myPlot->X2Pixel( (double)( a - base ) );
+            b = ( px >= lastpx ) ? last : std::max( a + 1, frameAt( px+1 ) );
+            double mn, mx;
+            myHistory->range( a - myHistoryOrigin, b - myHistoryOrigin, mn, mx );
+            columns.push_back( px );
+            myYBuf.push_back( myHistory->at( a - myHistoryOrigin ) );
+            myYBuf.push_back( mn );
+            myYBuf.push_back( mx );
+            myYBuf.push_back( myHistory->at( b - 1 - myHistoryOrigin ) );
+        }
+        pixels();
+        for( int k = 0; k < (int)columns.size(); k++ )
+            for( int j = 4 * k; j < 4 * k + 4; j++ )
+                env.add( columns[ k ], myYPx[ j ] );
+    }
+    env.flush();
+    polyline( graph );
+}
+
+long long trace::firstSampleAt( int px )
+{
+    long long n = mySeries.size();
+    if( myXSeries.size() )
+    {
+        // binary search of increasing x values
+        long long lo = 0;
+        long long hi = n;
+        while( lo < hi )
+        {
+            long long mid = lo + ( hi - lo ) / 2;
+            if( myPlot->X2Pixel( myXSeries[ mid ] ) < px )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    // estimate from inverse of plot::X2Pixel
+    // then correct for rounding
+    double x = ceil( myPlot->Pixel2X( px ) );
+    long long i = std::max( 0.0, std::min( x, (double)n ) );
+    while( i > 0 && myPlot->X2Pixel( i-1 ) >= px )
+        i--;
+    while( i < n && myPlot->X2Pixel( i ) < px )
+        i++;
+    return i;
+}
+
+int trace::scrollPixel( long long a ) const
+{
+    return floor( myPlot->myXScale * a );
+}
+
+void trace::scrollUpdate( rasterizer& graph, long long first, long long last, int xlast )
+{
+    int w = myRing->width();
+    long long total = myRing->total();
+    const double * y = myRing->channel( myChannel );
+    first = std::max( first, total - w );
+    last = std::min( last, total );
+    int xtotal = scrollPixel( total - 1 );
+
+    envelope env( myLine );
+    for( long long a = first; a < last; a++ )
+    {
+        // location of sample in circular buffer
+        int yidx = ( myRing->next() - (int)( total - a ) + w ) % w;
+        env.add(
+            xlast - ( xtotal - scrollPixel( a ) ),
+            myPlot->Y2Pixel( y[ yidx ] ) );
+    }
+    env.flush();
+
+    polyline( graph );
+}
+
+long long trace::nearest( double x, double y, int radius )
+{
+    long long d2;
+    return nearest( point( myPlot->X2Pixel( x ), myPlot->Y2Pixel( y ) ), radius, d2 );
+}
+
+long long trace::nearest( const point& p, int radius, long long& d2 )
+{
+    if( myType != eType::scatter )
+        throw std::runtime_error("nanaplot error: nearest point requested from non scatter type trace");
+    myfIndex = true;
+    myIndex.update( myX, myY );
+
+    // a point drawn within radius pixels is less than radius + 1 pixels away before truncation
+    double x = myPlot->Pixel2X( p.x );
+    double y = myPlot->Pixel2Y( p.y );
+    double rx = ( radius + 1 ) / myPlot->myXScale;
+    double ry = ( radius + 1 ) / myPlot->myYScale;
+
+    long long found = -1;
+    d2 = (long long)radius * radius;
+    std::vector< unsigned > candidates;
+    for( int d = 0; ; d++ )
+    {
+        // truncation moves each drawn point less than 2 pixels
+        double gap = myIndex.gap( d, rx, ry ) * ( radius + 1 ) - 2;
+        if( gap > 0 && gap * gap > d2 )
+            break;
+        if( ! myIndex.ring( x, y, rx, ry, d, candidates ) )
+            break;
+
+        const size_t BATCH = 1024;
+        for( size_t a = 0; a < candidates.size(); a += BATCH )
+        {
+            size_t n = std::min( BATCH, candidates.size() - a );
+            for( size_t k = a; k < a + n; k++ )
+            {
+                myXBuf.push_back( myX[ candidates[ k ] ] );
+                myYBuf.push_back( myY[ candidates[ k ] ] );
+            }
+            pixels();
+            for( size_t k = 0; k < n; k++ )
+            {
+                long long dx = myXPx[ k ] - p.x;
+                long long dy = myYPx[ k ] - p.y;
+                long long dk = dx * dx + dy * dy;
+                if( dk <= d2 )
+                {
+                    d2 = dk;
+                    found = candidates[ a + k ];
+                }
+            }
+        }
+    }
+    return found;
+}
+
+void trace::inside( double xmin, double xmax, double ymin, double ymax,
+                    std::vector< long long >& hits )
+{
+    if( myType != eType::scatter )
+        throw std::runtime_error("nanaplot error: points inside rectangle requested from non scatter type trace");
+    myfIndex = true;
+    myIndex.update( myX, myY );
+    myIndex.inside( myX, myY, xmin, xmax, ymin, ymax, hits );
+}
+
+const unsigned point_index::NONE;
+
+void point_index::clear()
+{
+    myCols = myRows = 0;
+    myCellW = myCellH = 1;
+    myHead.clear();
+    myNext.clear();
+    myOutside.clear();
+    myCount = 0;
+}
+
+int point_index::cell( double x, double y ) const
+{
+    double c = ( x - myX0 ) / myCellW;
+    double r = ( y - myY0 ) / myCellH;
+    // written so that nan is outside too
+    if( ! ( c >= 0 && c < myCols && r >= 0 && r < myRows ) )
+        return -1;
+    return (int)r * myCols + (int)c;
+}
+
+void point_index::build( const std::vector< double >& x, const std::vector< double >& y )
+{
+    long long n = x.size();
+    double xmin = x[ 0 ], xmax = x[ 0 ], ymin = y[ 0 ], ymax = y[ 0 ];
+    for( long long k = 1; k < n; k++ )
+    {
+        xmin = std::min( xmin, x[ k ] );
+        xmax = std::max( xmax, x[ k ] );
+        ymin = std::min( ymin, y[ k ] );
+        ymax = std::max( ymax, y[ k ] );
+    }
+
+    // about 4 points per cell, with room for the data to double
+    int side = std::max( 1.0, std::min( 4096.0, sqrt( n / 4.0 ) ) );
+    myCols = myRows = side;
+    myX0 = xmin;
+    myY0 = ymin;
+    // widen a little so the largest values fall inside the last cell
+    myCellW = std::max( xmax - xmin, 1e-12 ) * ( 1 + 1e-9 ) / myCols;
+    myCellH = std::max( ymax - ymin, 1e-12 ) * ( 1 + 1e-9 ) / myRows;
+
+    myHead.assign( myCols * myRows, NONE );
+    myNext.assign( n, NONE );
+    myOutside.clear();
+    myCount = 0;
+}
+
+void point_index::update( const std::vector< double >& x, const std::vector< double >& y )
+{
+    long long n = x.size();
+    if( n == myCount )
+        return;
+    if( ! myCols
+            || (long long)myOutside.size() > std::max( (long long)1024, myCount / 64 )
+            || ( n > 16LL * myCols * myRows && myCols < 4096 ) )
+        build( x, y );
+    myNext.resize( n, NONE );
+    for( long long k = myCount; k < n; k++ )
+    {
+        int c = cell( x[ k ], y[ k ] );
+        if( c < 0 )
+        {
+            myOutside.push_back( k );
+            continue;
+        }
+        myNext[ k ] = myHead[ c ];
+        myHead[ c ] = k;
+    }
+    myCount = n;
+}
+
+bool point_index::ring(
+    double x, double y, double rx, double ry, int d,
+    std::vector< unsigned >& candidates ) const
+{
+    candidates.clear();
+    if( ! d )
+        candidates = myOutside;
+    if( ! myCols )
+        return ! d;
+
+    // cells overlapping the search rectangle
+    int c0 = std::max( 0.0, floor( ( x - rx - myX0 ) / myCellW ) );
+    int c1 = std::min( myCols - 1.0, floor( ( x + rx - myX0 ) / myCellW ) );
+    int r0 = std::max( 0.0, floor( ( y - ry - myY0 ) / myCellH ) );
+    int r1 = std::min( myRows - 1.0, floor( ( y + ry - myY0 ) / myCellH ) );
+    if( c0 > c1 || r0 > r1 )
+        return ! d;
+
+    // rings of cells outward from the cell holding the location
+    int cc = std::max( c0, std::min( c1, (int)floor( ( x - myX0 ) / myCellW ) ) );
+    int rc = std::max( r0, std::min( r1, (int)floor( ( y - myY0 ) / myCellH ) ) );
+    int rings = std::max( std::max( cc - c0, c1 - cc ), std::max( rc - r0, r1 - rc ) );
+    if( d > rings )
+        return false;
+    for( int r = std::max( r0, rc - d ); r <= std::min( r1, rc + d ); r++ )
+    {
+        // whole row on the top and bottom of the ring, end cells otherwise
+        bool edge = ( r == rc - d || r == rc + d );
+        int step = edge ? 1 : 2 * d;
+        for( int c = cc - d; c <= cc + d; c += std::max( step, 1 ) )
+        {
+            if( c < c0 || c > c1 )
+                continue;
+            for( unsigned k = myHead[ r * myCols + c ]; k != NONE; k = myNext[ k ] )
+                candidates.push_back( k );
+        }
+    }
+    return true;
+}
+
+void point_index::inside(
+    const std::vector< double >& x, const std::vector< double >& y,
+    double xmin, double xmax, double ymin, double ymax,
+    std::vector< long long >& hits ) const
+{
+    auto in = [&]( unsigned k )
+    {
+        return xmin <= x[ k ] && x[ k ] <= xmax && ymin <= y[ k ] && y[ k ] <= ymax;
+    };
+    for( unsigned k : myOutside )
+        if( in( k ) )
+            hits.push_back( k );
+    if( ! myCols )
+        return;
 
-        // calculate scaling factors
-        // so plot will fit
-        CalcScale(
-            graph.width(),
-            graph.height() );
+    int c0 = std::max( 0.0, floor( ( xmin - myX0 ) / myCellW ) );
+    int c1 = std::min( myCols - 1.0, floor( ( xmax - myX0 ) / myCellW ) );
+    int r0 = std::max( 0.0, floor( ( ymin - myY0 ) / myCellH ) );
+    int r1 = std::min( myRows - 1.0, floor( ( ymax - myY0 ) / myCellH ) );
+    for( int r = r0; r <= r1; r++ )
+        for( int c = c0; c <= c1; c++ )
+        {
+            // points in interior cells need no test
+            bool edge = r == r0 || r == r1 || c == c0 || c == c1;
+            for( unsigned k = myHead[ r * myCols + c ]; k != NONE; k = myNext[ k ] )
+                if( ! edge || in( k ) )
+                    hits.push_back( k );
+        }
+}
 
-        // draw axis
-        myAxis->update( graph );
-        myAxisX->update( graph );
+void trace::density( long long threshold )
+{
+    myDensityThreshold = threshold;
+    myPlot->LayersChanged();
+}
 
-        // loop over traces
-        for( auto t : myTrace )
+void trace::bin( std::vector< unsigned >& count, int w, int h,
+                 long long first, long long last ) const
+{
+    const int BATCH = 1024;
+    int px[ BATCH ], py[ BATCH ];
+    for( long long a = first; a < last; a += BATCH )
+    {
+        int n = std::min( (long long)BATCH, last - a );
+        myPlot->X2Pixel( myX.data() + a, px, n );
+        myPlot->Y2Pixel( myY.data() + a, py, n );
+        for( int k = 0; k < n; k++ )
         {
-            // draw a trace
-            t->update( graph );
+            // unsigned compare rejects negative pixels too
+            if( (unsigned)px[ k ] < (unsigned)w && (unsigned)py[ k ] < (unsigned)h )
+                count[ py[ k ] * w + px[ k ] ]++;
         }
-    });
+    }
 }
 
-void plot::CalcScale( int w, int h )
+void trace::heatmap( rasterizer& graph )
 {
-    w *= 0.9;
-    h *= 0.95;
+    int w = graph.width();
+    int h = graph.height();
+    if( w <= 0 || h <= 0 )
+        return;
+    long long n = myX.size();
 
-    int maxCount = 0;
-    myTrace[0]->bounds(
-        myMinX, myMaxX,
-        myMinY, myMaxY );
-    for( auto& t : myTrace )
+    // each thread counts its share of the points into its own grid
+    // so no locking is needed, then the grids are added together
+    const long long MIN_PER_THREAD = 1 << 16;
+    int threads = std::max( 1u, std::thread::hardware_concurrency() );
+    threads = std::min( (long long)std::min( threads, 8 ), n / MIN_PER_THREAD + 1 );
+    std::vector< std::vector< unsigned > > grid( threads );
+    std::vector< std::thread > worker;
+    long long share = n / threads + 1;
+    for( int t = 0; t < threads; t++ )
     {
-        if( t->size() > maxCount )
-            maxCount = t->size();
-        double txmin, txmax, tymin, tymax;
-        t->bounds( txmin, txmax, tymin, tymax );
-        if( txmin < myMinX )
-            myMinX = txmin;
-        if( txmax > myMaxX )
-            myMaxX = txmax;
-        if( tymin < myMinY )
-            myMinY = tymin;
-        if( tymax > myMaxY )
-            myMaxY = tymax;
+        grid[ t ].resize( w * h );
+        long long first = t * share;
+        long long last = std::min( n, first + share );
+        if( t == threads - 1 )
+            bin( grid[ t ], w, h, first, last );
+        else
+            worker.push_back( std::thread( &trace::bin, this, std::ref( grid[ t ] ), w, h, first, last ) );
     }
-    if( ! maxCount )
+    for( auto& t : worker )
+        t.join();
+    std::vector< unsigned >& count = grid.back();
+    for( int t = 0; t < threads - 1; t++ )
+        for( int k = 0; k < w * h; k++ )
+            count[ k ] += grid[ t ][ k ];
+
+    // colour ramp, by log of count so sparse pixels stay visible
+    const unsigned * ramp = colourRamp();
+    unsigned mx = *std::max_element( count.begin(), count.end() );
+    if( ! mx )
         return;
-    if( fabs( myMaxX - myMinX) < 0.0001 )
-        myXScale = 1;
-    else
-        myXScale = 0.9 * w / ( myMaxX - myMinX );
-    if( fabs( myMaxY - myMinY ) < 0.0001 )
-        myYScale = 1;
-    else
-        myYScale = 0.9 * h / ( myMaxY - myMinY );
+    double scale = 255 / log( 1.0 + mx );
 
-    myXOffset = 0.05 * w;
-    myYOffset = h - 10 + myYScale * myMinY;
+    for( int y = 0; y < h; y++ )
+    {
+        pixel_argb_t * row = graph.row( y );
+        const unsigned * c = count.data() + y * w;
+        for( int x = 0; x < w; x++ )
+        {
+            if( c[ x ] )
+                row[ x ].value = ramp[ (int)( scale * log( 1.0 + c[ x ] ) ) ];
+        }
+    }
+}
 
-    //std::cout << myMinY <<" "<< myMaxY <<" "<< myScale;
+void trace::pixels()
+{
+    myXPx.resize( myXBuf.size() );
+    myYPx.resize( myYBuf.size() );
+    myPlot->X2Pixel( myXBuf.data(), myXPx.data(), myXBuf.size() );
+    myPlot->Y2Pixel( myYBuf.data(), myYPx.data(), myYBuf.size() );
+    myXBuf.clear();
+    myYBuf.clear();
 }
-void trace::set( const std::vector< double >& y )
+
+void trace::polyline( rasterizer& graph )
 {
-    if( myType != eType::plot )
-        throw std::runtime_error("nanaplot error: plot data added to non plot trace");
+    graph.polyline( myLine, myColor );
+}
 
-    myY = y;
+rasterizer::rasterizer( paint::graphics& graph )
+    : myGraph( graph )
+    , myWidth( graph.width() )
+    , myHeight( graph.height() )
+    , myLeft( 0 )
+    , myRight( myWidth - 1 )
+{
+    myBuffer.open( graph.handle() );
+}
 
-    std::cout << "plot::trace::set " << myY.size() << "\n";
+rasterizer::rasterizer( paint::graphics& graph, int left, int right )
+    : myGraph( graph )
+    , myWidth( graph.width() )
+    , myHeight( graph.height() )
+    , myLeft( std::max( 0, left ) )
+    , myRight( std::min( myWidth - 1, right ) )
+{
+    if( myLeft <= myRight )
+        myBuffer.open( graph.handle(), rectangle( myLeft, 0, myRight - myLeft + 1, myHeight ) );
 }
-void trace::add( double y )
+
+void rasterizer::paste()
 {
-    if( myType != eType::realtime )
-        throw std::runtime_error("nanaplot error: realtime data added to non realtime trace");
-    myY[ myRealTimeNext++ ] = y;
-    if( myRealTimeNext >= (int)myY.size() )
-        myRealTimeNext = 0;
+    if( myLeft <= myRight )
+        myBuffer.paste( myGraph.handle(), point( myLeft, 0 ) );
+}
 
-    myPlot->update();
+void rasterizer::polyline( const std::vector< point >& line, const color& clr )
+{
+    unsigned pixel = clr.px_color().value;
+    if( line.size() == 1 )
+        this->line( line[ 0 ], line[ 0 ], pixel );
+    for( int k = 1; k < (int)line.size(); k++ )
+        this->line( line[ k-1 ], line[ k ], pixel );
 }
 
-void trace::add( double x, double y )
+void rasterizer::frame( const rectangle& r, const color& clr )
 {
-    if( myType != eType::scatter )
-        throw std::runtime_error("nanaplot error: point data added to non scatter type trace");
-    myX.push_back( x );
-    myY.push_back( y );
+    unsigned pixel = clr.px_color().value;
+    int right = r.x + r.width - 1;
+    int bottom = r.y + r.height - 1;
+    line( point( r.x, r.y ), point( right, r.y ), pixel );
+    line( point( right, r.y ), point( right, bottom ), pixel );
+    line( point( right, bottom ), point( r.x, bottom ), pixel );
+    line( point( r.x, bottom ), point( r.x, r.y ), pixel );
 }
 
-void trace::bounds(
-    double& txmin, double& txmax,
-    double& tymin, double& tymax )
+bool rasterizer::clip( int& x0, int& y0, int& x1, int& y1 ) const
 {
-    if( myY.size() )
+    // Cohen-Sutherland
+    const int LEFT = 1, RIGHT = 2, TOP = 4, BOTTOM = 8;
+    int xmax = myWidth - 1;
+    int ymax = myHeight - 1;
+    auto code = [&]( double x, double y )
     {
-        if( myType == eType::realtime || myX.size() == 0 )
+        int c = 0;
+        if( x < 0 )
+            c |= LEFT;
+        else if( x > xmax )
+            c |= RIGHT;
+        if( y < 0 )
+            c |= TOP;
+        else if( y > ymax )
+            c |= BOTTOM;
+        return c;
+    };
+    double ax = x0, ay = y0, bx = x1, by = y1;
+    int ca = code( ax, ay );
+    int cb = code( bx, by );
+    for( ;; )
+    {
+        if( ! ( ca | cb ) )
+            break;
+        if( ca & cb )
+            return false;
+        int c = ca ? ca : cb;
+        double x, y;
+        if( c & BOTTOM )
         {
-            txmin = 0;
-            txmax = myY.size();
+            x = ax + ( bx - ax ) * ( ymax - ay ) / ( by - ay );
+            y = ymax;
+        }
+        else if( c & TOP )
+        {
+            x = ax + ( bx - ax ) * ( 0 - ay ) / ( by - ay );
+            y = 0;
+        }
+        else if( c & RIGHT )
+        {
+            y = ay + ( by - ay ) * ( xmax - ax ) / ( bx - ax );
+            x = xmax;
+        }
+        else
+        {
+            y = ay + ( by - ay ) * ( 0 - ax ) / ( bx - ax );
+            x = 0;
+        }
+        if( c == ca )
+        {
+            ax = x;
+            ay = y;
+            ca = code( ax, ay );
         }
         else
         {
-            auto result = std::minmax_element(
-                              myX.begin(),
-                              myX.end());
-            txmin = *result.first;
-            txmax = *result.second;
+            bx = x;
+            by = y;
+            cb = code( bx, by );
         }
-        auto result = std::minmax_element(
-                          myY.begin(),
-                          myY.end());
-        tymin = *result.first;
-        tymax = *result.second;
     }
+    x0 = std::lround( ax );
+    y0 = std::lround( ay );
+    x1 = std::lround( bx );
+    y1 = std::lround( by );
+    return true;
 }
 
-void trace::update( paint::graphics& graph )
+void rasterizer::fill( const rectangle& r, const color& clr )
 {
-    bool first = true;
-    int xi    = 0;
-    float xinc = myPlot->xinc();
-    double prevX, prev;
+    unsigned pixel = clr.px_color().value;
+    int left = std::max( r.x, myLeft );
+    int right = std::min( r.x + (int)r.width - 1, myRight );
+    int top = std::max( r.y, 0 );
+    int bottom = std::min( r.y + (int)r.height - 1, myHeight - 1 );
+    for( int y = top; y <= bottom; y++ )
+    {
+        pixel_argb_t * row = myBuffer.raw_ptr( y );
+        for( int x = left; x <= right; x++ )
+            row[ x - myLeft ].value = pixel;
+    }
+}
 
+void rasterizer::line( const point& a, const point& b, unsigned pixel )
+{
+    int x0 = a.x, y0 = a.y, x1 = b.x, y1 = b.y;
+    if( x0 < 0 || x0 >= myWidth || y0 < 0 || y0 >= myHeight
+            || x1 < 0 || x1 >= myWidth || y1 < 0 || y1 >= myHeight )
+    {
+        if( ! clip( x0, y0, x1, y1 ) )
+            return;
+    }
 
-    switch( myType )
+    if( x0 == x1 )
     {
-    case eType::plot:
+        // vertical, the commonest line in a decimated trace
+        if( x0 < myLeft || x0 > myRight )
+            return;
+        if( y0 > y1 )
+            std::swap( y0, y1 );
+        for( int y = y0; y <= y1; y++ )
+            myBuffer.raw_ptr( y )[ x0 - myLeft ].value = pixel;
+        return;
+    }
+    if( y0 == y1 )
+    {
+        if( x0 > x1 )
+            std::swap( x0, x1 );
+        pixel_argb_t * row = myBuffer.raw_ptr( y0 );
+        for( int x = std::max( x0, myLeft ); x <= std::min( x1, myRight ); x++ )
+            row[ x - myLeft ].value = pixel;
+        return;
+    }
 
-        // loop over data points
-        for( auto y : myY )
+    // Bresenham
+    int dx = std::abs( x1 - x0 );
+    int sx = x0 < x1 ? 1 : -1;
+    int dy = -std::abs( y1 - y0 );
+    int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    for( ;; )
+    {
+        if( myLeft <= x0 && x0 <= myRight )
+            myBuffer.raw_ptr( y0 )[ x0 - myLeft ].value = pixel;
+        if( x0 == x1 && y0 == y1 )
+            break;
+        int e2 = 2 * err;
+        if( e2 >= dy )
+        {
+            err += dy;
+            x0 += sx;
+        }
+        if( e2 <= dx )
+        {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void pyramid::update( const series& y, long long first, long long last )
+{
+    long long n = y.size();
+
+    // size the levels to the data
+    // the top level has a single entry summarizing all the data
+    long long levelsize = ( n + BLOCK - 1 ) / BLOCK;
+    int levels = 0;
+    while( levelsize )
+    {
+        if( (int)myMin.size() <= levels )
+        {
+            myMin.resize( levels + 1 );
+            myMax.resize( levels + 1 );
+        }
+        myMin[ levels ].resize( levelsize );
+        myMax[ levels ].resize( levelsize );
+        levels++;
+        if( levelsize == 1 )
+            break;
+        levelsize = ( levelsize + 1 ) / 2;
+    }
+    myMin.resize( levels );
+    myMax.resize( levels );
+    if( first >= last || ! levels )
+        return;
+
+    // recalculate the first level entries that cover the changed samples
+    long long lo = first / BLOCK;
+    long long hi = ( last - 1 ) / BLOCK + 1;
+    for( long long k = lo; k < hi; k++ )
+    {
+        long long end = std::min( n, ( k + 1 ) * BLOCK );
+        double mn = y[ k * BLOCK ];
+        double mx = mn;
+        for( long long i = k * BLOCK + 1; i < end; i++ )
         {
-            // scale
-            double x  = myPlot->X2Pixel( xi );
-            double ys = myPlot->Y2Pixel( y );
+            double v = y[ i ];
+            mn = std::min( mn, v );
+            mx = std::max( mx, v );
+        }
+        myMin[ 0 ][ k ] = mn;
+        myMax[ 0 ][ k ] = mx;
+    }
 
-            if( first )
+    // propagate up the levels
+    for( int level = 1; level < levels; level++ )
+    {
+        const std::vector< double >& pmin = myMin[ level-1 ];
+        const std::vector< double >& pmax = myMax[ level-1 ];
+        lo /= 2;
+        hi = ( hi - 1 ) / 2 + 1;
+        for( long long k = lo; k < hi; k++ )
+        {
+            long long c = 2 * k;
+            myMin[ level ][ k ] = pmin[ c ];
+            myMax[ level ][ k ] = pmax[ c ];
+            if( c + 1 < (long long)pmin.size() )
             {
-                first = false;
-                prevX = x;
-                prev = ys;
-                continue;
+                myMin[ level ][ k ] = std::min( pmin[ c ], pmin[ c+1 ] );
+                myMax[ level ][ k ] = std::max( pmax[ c ], pmax[ c+1 ] );
             }
+        }
+    }
+}
 
-            // draw line from previous to this data point
-            graph.line(
-                point(prevX, prev),
-                point(x, ys),
-                myColor);
+void pyramid::range(
+    const series& y,
+    long long first, long long last,
+    double& mn, double& mx ) const
+{
+    mn = std::numeric_limits<double>::max();
+    mx = -mn;
 
-            prevX = x;
-            prev = ys;
-            xi++;
+    // samples outside whole blocks are read directly
+    long long a = ( first + BLOCK - 1 ) / BLOCK;
+    long long b = last / BLOCK;
+    if( a >= b || myMin.empty() )
+    {
+        for( long long k = first; k < last; k++ )
+        {
+            mn = std::min( mn, y[ k ] );
+            mx = std::max( mx, y[ k ] );
         }
-        break;
+        return;
+    }
+    for( long long k = first; k < a * BLOCK; k++ )
+    {
+        mn = std::min( mn, y[ k ] );
+        mx = std::max( mx, y[ k ] );
+    }
+    for( long long k = b * BLOCK; k < last; k++ )
+    {
+        mn = std::min( mn, y[ k ] );
+        mx = std::max( mx, y[ k ] );
+    }
 
-    case eType::scatter:
+    // climb the levels, taking unpaired entries at each end
+    for( int level = 0; a < b; level++ )
+    {
+        if( a & 1 )
+        {
+            mn = std::min( mn, myMin[ level ][ a ] );
+            mx = std::max( mx, myMax[ level ][ a ] );
+            a++;
+        }
+        if( b & 1 )
+        {
+            b--;
+            mn = std::min( mn, myMin[ level ][ b ] );
+            mx = std::max( mx, myMax[ level ][ b ] );
+        }
+        a /= 2;
+        b /= 2;
+    }
+}
+
+mapped_file::mapped_file( const std::string& path )
+    : myData( 0 )
+    , mySize( 0 )
+    , myHandle( 0 )
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(
+                      path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE )
+        throw std::runtime_error("nanaplot error: cannot open " + path );
+    LARGE_INTEGER size;
+    GetFileSizeEx( file, &size );
+    mySize = size.QuadPart;
+    if( mySize )
+    {
+        myHandle = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+        if( myHandle )
+            myData = (const char *) MapViewOfFile( myHandle, FILE_MAP_READ, 0, 0, 0 );
+        if( myHandle && ! myData )
+            CloseHandle( myHandle );
+    }
+    CloseHandle( file );
+#else
+    int fd = open( path.c_str(), O_RDONLY );
+    if( fd < 0 )
+        throw std::runtime_error("nanaplot error: cannot open " + path );
+    struct stat st;
+    fstat( fd, &st );
+    mySize = st.st_size;
+    if( mySize )
+    {
+        void * p = mmap( 0, mySize, PROT_READ, MAP_SHARED, fd, 0 );
+        if( p != MAP_FAILED )
+            myData = (const char *) p;
+    }
+    close( fd );
+#endif
+    if( mySize && ! myData )
+        throw std::runtime_error("nanaplot error: cannot map " + path );
+    sequential( false );
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef _WIN32
+    if( myData )
+        UnmapViewOfFile( myData );
+    if( myHandle )
+        CloseHandle( myHandle );
+#else
+    if( myData )
+        munmap( (void *) myData, mySize );
+#endif
+    myData = 0;
+    myHandle = 0;
+}
+
+void mapped_file::sequential( bool f )
+{
+#ifndef _WIN32
+    if( myData )
+        madvise( (void *) myData, mySize, f ? MADV_SEQUENTIAL : MADV_RANDOM );
+#else
+    (void) f;
+#endif
+}
+
+/** \brief Parse a decimal number
+
+    Handles the common case, up to 19 significant digits and a small exponent,
+    by exact integer arithmetic and one multiplication.
+    Anything else is handed to strtod.
+    Leading spaces and quotes are skipped.
 
-        for( int k = 0; k < (int)myX.size(); k++ )
+    @param[in] p start of text
+    @param[in] end end of text
+    @param[out] v the number
+    @return pointer after the number, or p if there is no number
+*/
+static const char * parseNumber( const char * p, const char * end, double& v )
+{
+    static const double pow10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char * start = p;
+    while( p < end && ( *p == ' ' || *p == '"' ) )
+        p++;
+    const char * number = p;
+    bool negative = false;
+    if( p < end && ( *p == '-' || *p == '+' ) )
+        negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for( ; p < end && *p >= '0' && *p <= '9'; p++ )
+    {
+        any = true;
+        if( digits < 19 )
         {
-            graph.rectangle(
-                rectangle{ myPlot->X2Pixel( myX[ k ] )-5,  myPlot->Y2Pixel( myY[ k ] )-5,
-                           10, 10 },
-                false,
-                myColor );
+            mantissa = 10 * mantissa + ( *p - '0' );
+            if( mantissa )
+                digits++;
         }
-        break;
+        else
+            exponent++;
+    }
+    if( p < end && *p == '.' )
+    {
+        for( p++; p < end && *p >= '0' && *p <= '9'; p++ )
+        {
+            any = true;
+            if( digits < 19 )
+            {
+                mantissa = 10 * mantissa + ( *p - '0' );
+                if( mantissa )
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+    if( ! any )
+        return start;
+    if( p < end && ( *p == 'e' || *p == 'E' ) )
+    {
+        const char * q = p + 1;
+        bool eneg = false;
+        if( q < end && ( *q == '-' || *q == '+' ) )
+            eneg = *q++ == '-';
+        if( q < end && *q >= '0' && *q <= '9' )
+        {
+            int e = 0;
+            for( ; q < end && *q >= '0' && *q <= '9'; q++ )
+                if( e < 10000 )
+                    e = 10 * e + ( *q - '0' );
+            exponent += eneg ? -e : e;
+            p = q;
+        }
+    }
 
-    case eType::realtime:
+    if( digits == 19 || mantissa >= ( 1ULL << 53 ) || exponent < -22 || exponent > 22 )
+    {
+        // the fast path would round twice
+        char buf[ 128 ];
+        int len = std::min( (int)( p - number ), 127 );
+        std::copy( number, number + len, buf );
+        buf[ len ] = 0;
+        v = strtod( buf, 0 );
+        return p;
+    }
+    v = (double) mantissa;
+    if( exponent < 0 )
+        v /= pow10[ -exponent ];
+    else
+        v *= pow10[ exponent ];
+    if( negative )
+        v = -v;
+    return p;
+}
 
+csv_loader::csv_loader(
+    plot& thePlot,
+    const std::string& path,
+    char delimiter )
+    : myPlot( thePlot )
+    , myDelimiter( delimiter )
+    , myParsed( 0 )
+    , myfStop( false )
+    , myfParsed( false )
+    , myfDone( false )
+{
+    myFile = fopen( path.c_str(), "rb" );
+    if( ! myFile )
+        throw std::runtime_error("nanaplot error: cannot open " + path );
+    fseek( myFile, 0, SEEK_END );
+    mySize = ftell( myFile );
+    fseek( myFile, 0, SEEK_SET );
+
+    myTimer.interval( std::chrono::milliseconds( 50 ) );
+    myTimer.elapse([this]
     {
-        // loop over data points
+        poll();
+    });
+    myTimer.start();
 
-        // they are stored in a circular buffer
-        // so we have to start with the oldest data point
-        int yidx = myRealTimeNext;
-        do
+    myThread = std::thread( &csv_loader::parse, this );
+}
+
+csv_loader::~csv_loader()
+{
+    myfStop = true;
+    if( myThread.joinable() )
+        myThread.join();
+    fclose( myFile );
+}
+
+void csv_loader::parse()
+{
+    const int BUFSIZE = 1 << 20;
+    const int CHUNK = 1 << 16;                  // rows per chunk delivered
+    std::vector< char > buf( BUFSIZE );
+    std::vector< std::vector< double > > chunk;
+    std::vector< double > previous;
+    int rows = 0;
+    bool first = true;
+    int keep = 0;                               // partial line carried over
+
+    for( ;; )
+    {
+        if( myfStop )
+            return;
+        if( keep == BUFSIZE )
         {
-            double x = myPlot->X2Pixel( yidx );
-            double y = myPlot->Y2Pixel( myY[ yidx ] );
+            // line longer than buffer, give up on it
+            keep = 0;
+        }
+        int read = fread( buf.data() + keep, 1, BUFSIZE - keep, myFile );
+        bool eof = read < BUFSIZE - keep;
+        const char * p = buf.data();
+        const char * end = buf.data() + keep + read;
 
-            // the next data point
-            // with wrap-around if the end of the vector is reached
-            yidx++;
-            if( yidx >= (int)myY.size() )
-                yidx = 0;
+        for( ;; )
+        {
+            const char * eol = std::find( p, end, '\n' );
+            if( eol == end && ! eof )
+                break;
+            if( p == end )
+                break;
 
-            if( first )
+            // parse one line
+            const char * q = p;
+            const char * lineend = eol;
+            if( lineend > p && lineend[ -1 ] == '\r' )
+                lineend--;
+            if( lineend > p )
             {
-                first = false;
-                prevX = x;
-                prev = y;
-                continue;
-            }
-            // draw line from previous to this data point
-            graph.line(
-                point( prevX, prev ),
-                point( x, y ),
-                myColor);
+                double v;
+                if( first )
+                {
+                    first = false;
 
-            prevX = x;;
-            prev = y;
+                    // count columns
+                    int count = 1 + std::count( p, lineend, myDelimiter );
+                    chunk.resize( count );
+                    previous.resize( count, 0 );
 
+                    // skip header
+                    if( parseNumber( p, lineend, v ) == p )
+                    {
+                        p = eol + ( eol < end );
+                        continue;
+                    }
+                }
+                for( int col = 0; col < (int)chunk.size(); col++ )
+                {
+                    const char * field = std::find( q, lineend, myDelimiter );
+                    if( parseNumber( q, field, v ) != q )
+                        previous[ col ] = v;
+                    chunk[ col ].push_back( previous[ col ] );
+                    q = field + ( field < lineend );
+                }
+                rows++;
+            }
+            p = eol + ( eol < end );
+            if( rows == CHUNK )
+            {
+                std::lock_guard< std::mutex > lock( myMutex );
+                if( myPending.size() < chunk.size() )
+                    myPending.resize( chunk.size() );
+                for( int col = 0; col < (int)chunk.size(); col++ )
+                {
+                    myPending[ col ].insert( myPending[ col ].end(), chunk[ col ].begin(), chunk[ col ].end() );
+                    chunk[ col ].clear();
+                }
+                rows = 0;
+            }
         }
+        keep = end - p;
+        std::copy( p, end, buf.data() );
+        myParsed = ftell( myFile ) - keep;
+        if( eof )
+            break;
+    }
 
-        // check for end of circular buffer
-        // ( most recent point )
-        while( yidx != myRealTimeNext );
+    std::lock_guard< std::mutex > lock( myMutex );
+    if( myPending.size() < chunk.size() )
+        myPending.resize( chunk.size() );
+    for( int col = 0; col < (int)chunk.size(); col++ )
+        myPending[ col ].insert( myPending[ col ].end(), chunk[ col ].begin(), chunk[ col ].end() );
+    myParsed = mySize;
+    myfParsed = true;
+}
 
+void csv_loader::poll()
+{
+    bool fparsed = myfParsed;
+    std::vector< std::vector< double > > values;
+    {
+        std::lock_guard< std::mutex > lock( myMutex );
+        values.swap( myPending );
     }
-    break;
+
+    for( int col = 0; col < (int)values.size(); col++ )
+    {
+        if( col == (int)myTrace.size() )
+            myTrace.push_back( &myPlot.AddStaticTrace() );
+        myTrace[ col ]->extend( values[ col ].data(), values[ col ].size() );
+    }
+    if( values.size() )
+        myPlot.update();
+
+    if( fparsed )
+    {
+        myTimer.stop();
+        myfDone = true;
     }
 }
 
 axis::axis( plot * p, bool xaxis )
     : myPlot( p )
     , myfGrid( false )
-    , myLabelMin( myPlot->parent() )
-    , myLabelMax( myPlot->parent() )
-    , myLabelZero( myPlot->parent() )
     , myfX( xaxis )
+    , myTickMin( 0 )
+    , myTickMax( 0 )
+    , myTickCount( 0 )
+{
+}
+
+/** \brief round to a nice number, 1, 2, 5 or 10 times a power of ten
+    @param[in] v value to round, positive
+    @param[in] round true to round to nearest, false to round up
+
+    Heckbert, "Nice numbers for graph labels", Graphics Gems 1990
+*/
+static double nice( double v, bool round )
+{
+    double e = floor( log10( v ) );
+    double p = pow( 10, e );
+    double f = v / p;
+    double n;
+    if( round )
+        n = f < 1.5 ? 1 : f < 3 ? 2 : f < 7 ? 5 : 10;
+    else
+        n = f <= 1 ? 1 : f <= 2 ? 2 : f <= 5 ? 5 : 10;
+    return n * p;
+}
+
+void axis::ticks( paint::graphics& graph, double mn, double mx, int count )
 {
-    myLabelMin.move( { 10, 10, 50, 15 } );
-    myLabelMin.caption("test");
-    myLabelMax.move( { 10, 10, 50, 15 } );
-    myLabelMax.caption("test");
-    myLabelZero.move( { 10, 10, 50, 15 } );
-    myLabelZero.caption("0.0");
+    if( mn == myTickMin && mx == myTickMax && count == myTickCount )
+        return;
+    myTickMin = mn;
+    myTickMax = mx;
+    myTickCount = count;
+    myTick.clear();
+    myText.clear();
+    myExtent.clear();
+    if( ! ( mx > mn ) || count < 2 )
+        return;
+
+    double step = nice( nice( mx - mn, false ) / ( count - 1 ), true );
+    double first = ceil( mn / step - 1e-9 );
+    double last = floor( mx / step + 1e-9 );
+    if( ! ( step > 0 ) || ! ( last - first < 100 ) )
+        return;
+
+    // enough significant digits to tell neighbouring ticks apart
+    double largest = std::max( fabs( mn ), fabs( mx ) );
+    int digits = std::max( 6, (int)ceil( log10( largest / step ) ) + 1 );
+    for( double i = first; i <= last; i++ )
+    {
+        double v = i * step;
+        // avoid "-0"
+        if( i == 0 )
+            v = 0;
+        char text[ 32 ];
+        snprintf( text, sizeof( text ), "%.*g", digits, v );
+        myTick.push_back( v );
+        myText.push_back( text );
+        myExtent.push_back( graph.text_extent_size( myText.back() ) );
+    }
 }
 
 void axis::update( paint::graphics& graph )
 {
     if( ! myfX )
     {
-        double mn = 10 * ( myPlot->minY() / 10 );
-        double mx = 10 * ( myPlot->maxY() / 10 );
-        if( mx-mn < 2 )
-        {
-            mn = myPlot->minY();
-            mx = myPlot->maxY();
-        }
+        double mn = myPlot->minY();
+        double mx = myPlot->maxY();
         int ymn_px = myPlot->Y2Pixel( mn );
-        myLabelMin.caption(std::to_string(mn));
-        myLabelMin.move( 5,  ymn_px );
-
         int ymx_px = myPlot->Y2Pixel( mx );
-        myLabelMax.caption(std::to_string( mx ));
-        myLabelMax.move( 5,   ymx_px - 15 );
 
         graph.line( point( 2, ymn_px ),
                     point( 2, ymx_px ),
                     colors::black );
 
-        if( mn * mx < 0 )
+        ticks( graph, mn, mx, std::max( 2, ( ymn_px - ymx_px ) / 50 ) );
+        for( int k = 0; k < (int)myTick.size(); k++ )
         {
-            graph.line( point(2, ymx_px),
-                        point(5, ymx_px),
-                        colors::black );
-            int y0_px = myPlot->Y2Pixel( 0 );
-            myLabelZero.move( 5,   y0_px - 15 );
-            myLabelZero.show();
-            graph.line( point(2, y0_px),
-                        point(5, y0_px),
-                        colors::black );
-            graph.line( point(2, ymn_px),
-                        point(5, ymn_px),
+            int y = myPlot->Y2Pixel( myTick[ k ] );
+            graph.line( point(2, y),
+                        point(5, y),
                         colors::black );
+            graph.string( point( 8, y - (int)myExtent[ k ].height / 2 ),
+                          myText[ k ],
+                          colors::black );
             if( myfGrid )
-                for( int k=5; k<graph.width(); k=k+10 )
+                for( int x=5; x<(int)graph.width(); x=x+10 )
                 {
-                    graph.set_pixel(k, y0_px, colors::blue );
-                    graph.set_pixel(k+1, y0_px, colors::blue );
+                    graph.set_pixel(x, y, colors::blue );
+                    graph.set_pixel(x+1, y, colors::blue );
                 }
         }
-        else
-        {
-            myLabelZero.hide();
-            int yinc = ( ymn_px - ymx_px ) / 4;
-            for( int ky = 0; ky < 4; ky++ )
-            {
-                int y = ymx_px + ky * yinc;
-                graph.line( point(2, y),
-                            point(5, y),
-                            colors::black );
-                if( myfGrid )
-                    for( int k=5; k<graph.width(); k=k+10 )
-                    {
-                        graph.set_pixel(k, y, colors::blue );
-                        graph.set_pixel(k+1, y, colors::blue );
-                    }
-            }
-        }
     }
     else
     {
         // x-axis
         int ypos = graph.height() - 15;
 
-        double mn = 10 * ( myPlot->minX() / 10 );
-        double mx = 10 * ( myPlot->maxX() / 10 );
-        if( mx-mn < 2 )
-        {
-            mn = myPlot->minX();
-            mx = myPlot->maxX();
-        }
+        double mn = myPlot->minX();
+        double mx = myPlot->maxX();
         int xmn_px = myPlot->X2Pixel( mn );
-        myLabelMin.caption(std::to_string(mn));
-        myLabelMin.move( xmn_px, ypos+3 );
-
         int xmx_px = myPlot->X2Pixel( mx );
-        myLabelMax.caption(std::to_string( mx ));
-        myLabelMax.move( xmx_px - 15, ypos+ 3 );
 
         graph.line( point( xmn_px, ypos ),
                     point( xmx_px, ypos ),
                     colors::black );
+
+        ticks( graph, mn, mx, std::max( 2, ( xmx_px - xmn_px ) / 100 ) );
+        for( int k = 0; k < (int)myTick.size(); k++ )
+        {
+            int x = myPlot->X2Pixel( myTick[ k ] );
+            graph.line( point(x, ypos),
+                        point(x, ypos+2),
+                        colors::black );
+            graph.string( point( x - (int)myExtent[ k ].width / 2, ypos + 2 ),
+                          myText[ k ],
+                          colors::black );
+        }
     }
 }
 
-
 }
 }
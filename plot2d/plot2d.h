@@ -1,5 +1,17 @@
+#include <deque>
+#include <fstream>
+#include <string>
+#include <functional>
+#include <limits>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <nana/gui.hpp>
-#include <nana/gui/widgets/label.hpp>
+#include <nana/gui/timer.hpp>
+#include <nana/paint/pixel_buffer.hpp>
 #include <nana/gui.hpp>
 
 namespace nana
@@ -7,6 +19,871 @@ namespace nana
 namespace plot
 {
 class plot;
+class realtime_group;
+
+/** \brief Read only view of the samples of a static trace
+
+    The samples may belong to the trace,
+    or to the application which promises they stay valid
+    for as long as the view is in use.
+    Samples need not be contiguous: successive samples are stride values apart.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class series
+{
+public:
+
+    /// type of stored values
+    enum class eValue
+    {
+        f64,
+        f32,
+        i32,
+        i16
+    };
+
+    series()
+        : myData( 0 )
+        , myValue( eValue::f64 )
+        , myCount( 0 )
+        , myStride( 1 )
+        , myScale( 1 )
+        , myOffset( 0 )
+    {
+
+    }
+
+    /** \brief point view at samples
+        @param[in] data first sample
+        @param[in] value type of stored values
+        @param[in] count number of samples
+        @param[in] stride distance between successive samples, in values
+        @param[in] owner keeps the samples alive, may be empty
+    */
+    void view(
+        const void * data,
+        eValue value,
+        long long count,
+        int stride = 1,
+        std::shared_ptr< const void > owner = std::shared_ptr< const void >() )
+    {
+        myData = data;
+        myValue = value;
+        myCount = count;
+        myStride = stride;
+        myOwner = owner;
+        myScale = 1;
+        myOffset = 0;
+    }
+
+    /** \brief convert stored values when read
+        @param[in] scale multiplies stored value
+        @param[in] offset added to scaled value
+
+        Lets integer ADC counts, for example, be shown in physical units.
+    */
+    void transform( double scale, double offset )
+    {
+        myScale = scale;
+        myOffset = offset;
+    }
+
+    /// point view at double samples
+    void view(
+        const double * data,
+        long long count,
+        int stride = 1,
+        std::shared_ptr< const void > owner = std::shared_ptr< const void >() )
+    {
+        view( data, eValue::f64, count, stride, owner );
+    }
+
+    /// stop viewing
+    void clear()
+    {
+        view( 0, 0 );
+    }
+
+    double operator[]( long long i ) const
+    {
+        i *= myStride;
+        switch( myValue )
+        {
+        case eValue::f32:
+            return myScale * static_cast< const float * >( myData )[ i ] + myOffset;
+        case eValue::i32:
+            return myScale * static_cast< const int32_t * >( myData )[ i ] + myOffset;
+        case eValue::i16:
+            return myScale * static_cast< const int16_t * >( myData )[ i ] + myOffset;
+        default:
+            return myScale * static_cast< const double * >( myData )[ i ] + myOffset;
+        }
+    }
+
+    long long size() const
+    {
+        return myCount;
+    }
+
+private:
+    const void * myData;
+    eValue myValue;
+    long long myCount;
+    int myStride;
+    double myScale;
+    double myOffset;
+    std::shared_ptr< const void > myOwner;
+};
+
+/** \brief Read only memory mapping of a whole file
+
+    Pages are read from disk only when they are touched,
+    so opening costs the same whatever the file size.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class mapped_file
+{
+public:
+
+    /** CTOR
+        @param[in] path file to map
+
+        An exception is thrown if the file cannot be mapped
+    */
+    mapped_file( const std::string& path );
+
+    ~mapped_file();
+
+    const char * data() const
+    {
+        return myData;
+    }
+
+    /// size of file, bytes
+    long long size() const
+    {
+        return mySize;
+    }
+
+    /** \brief hint how the pages will be read
+        @param[in] f true for one pass from start to end, false for scattered reads
+    */
+    void sequential( bool f );
+
+private:
+    const char * myData;
+    long long mySize;
+    void * myHandle;            ///< file mapping handle, windows only
+
+    mapped_file( const mapped_file& );
+    mapped_file& operator=( const mapped_file& );
+};
+
+/** \brief Min and max summaries of a data series at 16x, 32x, 64x ... reduction
+
+    Finds the min and max of any range of samples
+    while reading at most a few dozen values per level,
+    so a pixel column covering millions of samples costs O( log n ).
+
+    The first level summarizes blocks of 16 samples,
+    which bounds the memory overhead to a quarter of the data size.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class pyramid
+{
+public:
+
+    /// samples summarized by each entry of the first level
+    static const int BLOCK = 16;
+
+    /// discard all summaries
+    void clear()
+    {
+        myMin.clear();
+        myMax.clear();
+    }
+
+    /** \brief update summaries after data has changed
+        @param[in] y the data
+        @param[in] first index of first changed sample
+        @param[in] last index after last changed sample
+
+        If the size of y has changed, last should be y.size()
+    */
+    void update( const series& y, long long first, long long last );
+
+    /** \brief min and max of all samples
+        @param[out] mn minimum
+        @param[out] mx maximum
+        @return false if there are no samples
+    */
+    bool bounds( double& mn, double& mx ) const
+    {
+        if( myMin.empty() )
+            return false;
+        mn = myMin.back()[ 0 ];
+        mx = myMax.back()[ 0 ];
+        return true;
+    }
+
+    /** \brief min and max of a range of samples
+        @param[in] y the data summarized
+        @param[in] first index of first sample in range
+        @param[in] last index after last sample in range
+        @param[out] mn minimum
+        @param[out] mx maximum
+    */
+    void range(
+        const series& y,
+        long long first, long long last,
+        double& mn, double& mx ) const;
+
+private:
+
+    /// min and max at each level, level k summarizes blocks of BLOCK * 2^k samples
+    std::vector< std::vector< double > > myMin;
+    std::vector< std::vector< double > > myMax;
+};
+
+/** \brief Uniform grid over scatter points, for hit testing
+
+    Each grid cell holds a linked list of the points inside it,
+    threaded through one index per point,
+    so appending a point costs O(1) and queries visit only nearby cells.
+
+    Points appended outside the grid wait in a list that is searched in full,
+    the grid is rebuilt over the new bounds when that list grows,
+    or when the cells become crowded.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class point_index
+{
+public:
+
+    point_index()
+    {
+        clear();
+    }
+
+    void clear();
+
+    /** \brief index points appended since the last call
+        @param[in] x locations of all points
+        @param[in] y locations of all points
+    */
+    void update( const std::vector< double >& x, const std::vector< double >& y );
+
+    /** \brief find points in one ring of cells around a location
+        @param[in] x location
+        @param[in] y location
+        @param[in] rx search radius in x units
+        @param[in] ry search radius in y units
+        @param[in] d ring, 0 is the cell holding the location, ring d is d cells out
+        @param[out] candidates indices of points in the ring's cells inside the search rectangle,
+            ring 0 also gives the points beyond the grid
+        @return false if ring d and all further rings hold no cells inside the search rectangle
+
+        The caller tests each candidate, in pixels, through the same transform that draws it,
+        working outward until gap() shows no closer point can remain.
+    */
+    bool ring(
+        double x, double y, double rx, double ry, int d,
+        std::vector< unsigned >& candidates ) const;
+
+    /** \brief distance to ring d
+        @return smallest distance from the location to a point in ring d or beyond,
+            as a multiple of the search radius, not positive for the nearest rings
+    */
+    double gap( int d, double rx, double ry ) const
+    {
+        return std::min( ( d - 1 ) * myCellW / rx, ( d - 1 ) * myCellH / ry );
+    }
+
+    /** \brief find points inside rectangle
+        @param[out] hits indices of points, in no particular order
+    */
+    void inside(
+        const std::vector< double >& x, const std::vector< double >& y,
+        double xmin, double xmax, double ymin, double ymax,
+        std::vector< long long >& hits ) const;
+
+private:
+    static const unsigned NONE = 0xFFFFFFFF;
+
+    double myX0, myY0;                  ///< bottom left corner of grid
+    double myCellW, myCellH;
+    int myCols, myRows;
+    std::vector< unsigned > myHead;     ///< first point in each cell
+    std::vector< unsigned > myNext;     ///< next point in same cell
+    std::vector< unsigned > myOutside;  ///< points beyond the grid
+    long long myCount;                  ///< number of points indexed
+
+    /// build grid over all points
+    void build( const std::vector< double >& x, const std::vector< double >& y );
+
+    /// cell holding location, or -1 if outside grid
+    int cell( double x, double y ) const;
+};
+
+/** \brief Min and max of the most recent samples in a sliding window
+
+    Keeps a monotonic deque of the samples that could still become
+    the min or the max, so each new sample costs amortized O(1)
+    and the bounds are read in O(1).
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class sliding_bounds
+{
+public:
+
+    /** \brief start again
+        @param[in] w number of samples in the window
+    */
+    void clear( int w )
+    {
+        myWidth = w;
+        myCount = 0;
+        myMin.clear();
+        myMax.clear();
+    }
+
+    /// add new sample, dropping the oldest once the window is full
+    void push( double y );
+
+    /// add new samples, oldest first
+    void push( const double * y, int count );
+
+    /** \brief drop old samples, for a window that is not a fixed number of samples
+        @param[in] first number of the oldest sample still in the window, counting from 0 at clear
+    */
+    void expire( long long first );
+
+    double min() const
+    {
+        return myMin.front().second;
+    }
+    double max() const
+    {
+        return myMax.front().second;
+    }
+
+private:
+    int myWidth;
+    long long myCount;                                  ///< samples pushed since clear
+
+    /// ( index, value ) of candidates, values increasing in myMin, decreasing in myMax
+    std::deque< std::pair< long long, double > > myMin;
+    std::deque< std::pair< long long, double > > myMax;
+};
+
+/** \brief Lock-free queue of samples from any number of producer threads
+
+    A bounded ring of cells, each with a sequence number
+    that tells producers and the consumer whose turn it is.
+    Producers never block: when the ring is full the sample is dropped and counted.
+    Only one thread, the GUI thread, may pop.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class ingest_queue
+{
+public:
+
+    /** CTOR
+        @param[in] capacity number of samples that can wait, rounded up to a power of 2
+    */
+    ingest_queue( int capacity );
+
+    /// add sample, from any thread. false if full
+    bool push( double y );
+
+    /** \brief remove waiting samples, from the consumer thread only
+        @param[out] y buffer for samples
+        @param[in] max size of buffer
+        @return number of samples removed
+    */
+    int pop( double * y, int max );
+
+    /// number of samples dropped because the queue was full
+    long long dropped() const
+    {
+        return myDropped.load( std::memory_order_relaxed );
+    }
+
+    int capacity() const
+    {
+        return (int) myCells.size();
+    }
+
+private:
+    struct cell
+    {
+        std::atomic< size_t > sequence;
+        double value;
+    };
+    std::vector< cell > myCells;
+    size_t myMask;
+
+    // keep producer and consumer positions on separate cache lines
+    char myPad0[ 64 ];
+    std::atomic< size_t > myEnqueue;
+    char myPad1[ 64 ];
+    size_t myDequeue;
+    char myPad2[ 64 ];
+    std::atomic< long long > myDropped;
+};
+
+/** \brief Spectra of the samples of a realtime trace, computed on a worker thread
+
+    The source trace passes its samples through a lock-free queue.
+    The worker takes frames of size samples, hop samples apart,
+    applies a Hann window and an in-tree radix-2 FFT,
+    and publishes the magnitudes in dB with their min and max.
+
+    Results pass through three buffers: the worker fills one,
+    the plot draws another, and the third holds the newest complete result.
+    Each side swaps its buffer with the third by one atomic exchange,
+    so neither ever waits for the other.
+    When the worker falls behind it skips to the newest complete frame.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class spectrum_worker
+{
+public:
+
+    /** CTOR, starts the worker thread
+        @param[in] size samples in each frame, a power of 2
+        @param[in] hop samples between the starts of successive frames
+    */
+    spectrum_worker( int size, int hop );
+
+    /// stop the worker thread
+    ~spectrum_worker();
+
+    /** \brief add samples of the source trace
+        @param[in] y first sample
+        @param[in] count number of samples
+        @param[in] stride distance between samples in y
+    */
+    void push( const double * y, int count, int stride );
+
+    /** \brief take the newest spectrum, from the GUI thread only
+        @return true if there is a spectrum newer than the last taken
+    */
+    bool acquire();
+
+    /// magnitudes in dB of the spectrum taken by acquire, size / 2 + 1 values
+    const std::vector< double >& spectrum() const
+    {
+        return myBuffer[ myFront ].y;
+    }
+    double min() const
+    {
+        return myBuffer[ myFront ].min;
+    }
+    double max() const
+    {
+        return myBuffer[ myFront ].max;
+    }
+
+    /// samples dropped because the worker did not keep up
+    long long dropped() const
+    {
+        return myQueue.dropped();
+    }
+
+private:
+    struct result
+    {
+        std::vector< double > y;
+        double min, max;
+    };
+    static const int FRESH = 4;         ///< flag in myMiddle: buffer not yet taken
+    result myBuffer[ 3 ];
+    int myFront;                        ///< buffer drawn by the plot
+    int myBack;                         ///< buffer filled by the worker
+    std::atomic< int > myMiddle;        ///< newest complete buffer, with FRESH flag
+
+    int mySize;
+    int myHop;
+    std::vector< double > myWindow;
+    double myGain;                      ///< scales a bin to the amplitude of a sinusoid
+    std::vector< double > myCos, mySin; ///< twiddle factors
+    std::vector< int > myReverse;       ///< bit reversed index
+    std::vector< double > myRe, myIm;   ///< FFT work space
+
+    ingest_queue myQueue;
+    std::atomic< bool > myfStop;
+    std::mutex myWakeMutex;
+    std::condition_variable myWake;
+    std::thread myThread;
+
+    /// worker thread
+    void run();
+
+    /// spectrum of size samples into r
+    void transform( const double * frame, result& r );
+};
+
+/** \brief Min and max summaries of a mapped file, built on a worker thread
+
+    A file of many GB takes seconds to read, too long to block the paint handler.
+    The worker reads the file once, from start to end, building its pyramid.
+    After each chunk it publishes coarse bins, the min and max of about
+    1 / BINS of the file each, for the samples summarized so far,
+    which the plot draws until the pyramid is complete.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class summary_worker
+{
+public:
+
+    /// a coarse summary of consecutive samples
+    struct bin
+    {
+        double x;                       ///< x value of first sample
+        double min, max;
+    };
+
+    /// number of bins covering the whole file
+    static const int BINS = 4096;
+
+    /** CTOR, starts the worker thread
+        @param[in] y the data, sharing ownership of the file
+        @param[in] x the x values, empty when x is the sample index
+        @param[in] file the mapped file, for read hints
+    */
+    summary_worker( const series& y, const series& x, std::shared_ptr< mapped_file > file );
+
+    /// stop the worker thread, abandoning the summary if incomplete
+    ~summary_worker();
+
+    /** \brief take bins published since the last call, from the GUI thread only
+        @param[in,out] bins bins taken so far, new bins are appended
+        @return true if there were new bins, or the pyramid has just been completed
+    */
+    bool acquire( std::vector< bin >& bins );
+
+    /// true when the pyramid is complete
+    bool ready() const
+    {
+        return myfReady;
+    }
+
+    /// move the completed pyramid to p
+    void take( pyramid& p );
+
+private:
+    series myY;
+    series myX;
+    std::shared_ptr< mapped_file > myFile;
+    pyramid myPyramid;
+    std::vector< bin > myBins;          ///< published, not yet taken by acquire
+    std::mutex myMutex;
+    std::atomic< bool > myfStop;
+    std::atomic< bool > myfReady;
+    bool myfReadyTaken;                 ///< acquire has reported completion
+    std::thread myThread;
+
+    /// worker thread
+    void run();
+};
+
+/** \brief Compressed store of the samples of a realtime trace
+
+    Samples are packed into blocks of BLOCK samples, each block in the shortest of
+    - the XOR float encoding of Gorilla ( Pelkonen et al, VLDB 2015 ):
+      each value is XORed with the one before and only the bits that differ are kept
+    - the same, XORed with the straight line through the two values before
+    - when every value is an integer divided by a power of ten,
+      differences of the integers in a Rice code
+
+    Signals rounded to a few decimal places, or integer ADC counts,
+    take 1.5 to 5 bits per sample, a constant 1 bit.
+    Full precision values, such as a computed sine or counts times a calibration factor,
+    still take about 50 bits per sample.
+
+    Each block records its min and max, so a zoomed out view
+    reads the summaries rather than decoding every sample.
+    Any range of samples is decoded by unpacking only the blocks it covers.
+
+    Once more than the samples to keep have been stored,
+    the oldest blocks are discarded.
+
+    Optionally each block is appended to a spill file as it is sealed,
+    and only the most recent blocks stay in memory.
+    An index of every block's first sample, min, max and file offset stays in memory,
+    so a range of samples reads just the blocks it covers from the file.
+    Blocks are written whole and flushed one at a time, each with a checksum,
+    so a crash loses at most the block being filled.
+    Reopening the file recovers the blocks in it.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class history_store
+{
+public:
+    static const int BLOCK = 4096;
+
+    /** \brief CTOR
+        @param[in] keep number of most recent samples to keep
+    */
+    history_store( long long keep );
+
+    /** \brief spill blocks to a file
+        @param[in] path file name, created if it does not exist
+        @param[in] memory bytes of compressed blocks to keep in memory
+
+        Call before any samples are pushed.
+        Blocks already in the file are recovered as the oldest samples.
+        The file is only ever appended, discarded blocks stay in it.
+    */
+    void spill( const std::string& path, long long memory );
+
+    /** \brief add samples
+        @param[in] y first sample
+        @param[in] count number of samples
+        @param[in] stride distance between samples in y
+    */
+    void push( const double * y, int count, int stride );
+
+    /// number of the oldest sample kept, counting from 0 for the first ever pushed
+    long long first() const
+    {
+        return myFirstBlock * BLOCK;
+    }
+
+    /// number of samples ever pushed
+    long long total() const
+    {
+        return myTotal;
+    }
+
+    /// value of sample i, first() <= i < total()
+    double at( long long i ) const
+    {
+        return samples( i / BLOCK )[ i % BLOCK ];
+    }
+
+    /// min and max of samples first to last - 1
+    void range( long long first, long long last, double& mn, double& mx ) const;
+
+    /// copy samples first to last - 1 into y
+    void read( long long first, long long last, double * y ) const;
+
+    /// bytes used by the compressed blocks
+    long long bytes() const
+    {
+        return myBytes;
+    }
+
+private:
+    struct block
+    {
+        std::vector< unsigned char > bits;  ///< empty when only in spill file
+        double min, max;
+        long long offset;               ///< of record in spill file, -1 if not spilled
+        unsigned length;                ///< bytes of encoded samples
+    };
+    std::deque< block > myBlock;
+    long long myFirstBlock;             ///< number of block at front of myBlock
+    std::vector< double > myOpen;       ///< samples of the block being filled
+    long long myKeep;
+    long long myTotal;
+    long long myBytes;
+    mutable std::fstream myFile;        ///< spill file, if open
+    long long myFileEnd;                ///< end of last complete record in spill file
+    long long myMemory;                 ///< bytes of blocks to keep in memory when spilling
+    long long myResident;               ///< bytes of blocks in memory
+    long long myResidentBlock;          ///< number of oldest block that may be in memory
+
+    /// most recently decoded block, neighbouring reads often share a block
+    mutable long long myCacheBlock;
+    mutable std::vector< double > myCache;
+
+    /// compress the open block
+    void seal();
+
+    /// XOR encode the open block
+    void encode( std::vector< unsigned char >& bits ) const;
+
+    /// decode block into myCache
+    void decode( const std::vector< unsigned char >& bits ) const;
+
+    /// append block to spill file
+    void write( block& b, long long first );
+
+    /// read records from spill file, keeping those that are complete
+    void recover();
+
+    /// samples of block k, decoded if needed
+    const double * samples( long long k ) const;
+};
+
+/** \brief Circular buffer of the recent samples of realtime traces sharing a timebase
+
+    Structure of arrays: each channel's samples are in one contiguous block
+    and all channels share one head index,
+    so a frame holding one sample for every channel is stored
+    by a single pass and a single index update.
+
+    A lone realtime trace has a ring of its own, with one channel.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class ring
+{
+public:
+
+    /** \brief CTOR
+        @param[in] channels number of traces sharing the ring
+        @param[in] w number of samples kept for each trace
+
+        The ring starts full of zeros.
+    */
+    ring( int channels, int w )
+        : myChannels( channels )
+        , myWidth( w )
+        , myData( (size_t)channels * w )
+        , myNext( 0 )
+        , myTotal( 0 )
+    {
+
+    }
+
+    int channels() const
+    {
+        return myChannels;
+    }
+
+    /// samples kept for each channel
+    int width() const
+    {
+        return myWidth;
+    }
+
+    /// samples of channel c, oldest at next()
+    const double * channel( int c ) const
+    {
+        return myData.data() + (size_t)c * myWidth;
+    }
+
+    /// location of oldest sample, where the next will be written
+    int next() const
+    {
+        return myNext;
+    }
+
+    /// number of frames ever added
+    long long total() const
+    {
+        return myTotal;
+    }
+
+    /** \brief add frames
+        @param[in] frames sample for channel c of frame f at frames[ f * channels() + c ]
+        @param[in] count number of frames, oldest first
+    */
+    void push( const double * frames, int count );
+
+private:
+    int myChannels;
+    int myWidth;
+    std::vector< double > myData;       ///< channel blocks, one after another
+    int myNext;
+    long long myTotal;
+};
+
+/** \brief Draw lines straight into the pixels of a graphics
+
+    The pixels are copied out of the graphics once,
+    every line is written into them by a Bresenham loop
+    that skips nana's per call overhead,
+    then the pixels are pasted back once.
+
+    Lines are clipped to the graphics, so any co-ordinates are safe.
+
+    This class is internal and none of its methods should be
+    called by the application code
+*/
+class rasterizer
+{
+public:
+
+    /// start drawing on graph
+    rasterizer( paint::graphics& graph );
+
+    /** \brief start drawing on some columns of graph
+        @param[in] graph where to draw
+        @param[in] left first column that may be drawn
+        @param[in] right last column that may be drawn
+
+        Only these columns are read into the buffer and pasted back.
+        Lines are still traced from end to end, only the pixels
+        outside the columns are skipped, so the pixels drawn
+        are exactly those a full drawing would give.
+    */
+    rasterizer( paint::graphics& graph, int left, int right );
+
+    /// copy the pixels back to the graphics
+    void paste();
+
+    int width() const
+    {
+        return myWidth;
+    }
+    int height() const
+    {
+        return myHeight;
+    }
+
+    /// pixels of row y, for code that fills whole areas of a rasterizer of all columns
+    pixel_argb_t * row( int y )
+    {
+        return myBuffer.raw_ptr( y );
+    }
+
+    /// draw line, including both end points
+    void line( const point& a, const point& b, unsigned pixel );
+
+    /// draw line through points
+    void polyline( const std::vector< point >& line, const color& clr );
+
+    /// draw outline of rectangle
+    void frame( const rectangle& r, const color& clr );
+
+    /// fill rectangle
+    void fill( const rectangle& r, const color& clr );
+
+private:
+    paint::graphics& myGraph;
+    paint::pixel_buffer myBuffer;
+    int myWidth;
+    int myHeight;
+    int myLeft, myRight;                ///< columns that may be drawn, myLeft is column 0 of myBuffer
+
+    /** \brief clip line to buffer
+        @return false if the line is wholly outside
+    */
+    bool clip( int& x0, int& y0, int& x1, int& y1 ) const;
+};
 
 /** \brief Single trace to be plotted
 
@@ -45,58 +922,419 @@ class trace
 {
 public:
 
-    /** \brief set plot data
-        @param[in] y vector of data points to display
+    /** \brief set plot data
+        @param[in] y vector of data points to display
+
+        Replaces any existing data.  Plot is NOT refreshed.
+        An exception is thrown when this is called
+        for a trace that is not plot type
+    */
+    void set( const std::vector< double >& y );
+
+    /** \brief set plot data stored in compact form
+        @param[in] y vector of data points to display
+        @param[in] scale multiplies stored value when drawn
+        @param[in] offset added to scaled value when drawn
+
+        The trace keeps the values in their own type,
+        so float data needs half, and 16 bit data a quarter,
+        of the memory of double data.
+        The values are converted when read for drawing.
+
+        scale and offset have no defaults,
+        so that set( { 1.0, 2.0 } ) still chooses the double overload.
+
+        Replaces any existing data.  Plot is NOT refreshed.
+        An exception is thrown when this is called
+        for a trace that is not plot type
+    */
+    void set( const std::vector< float >& y, double scale, double offset );
+    void set( const std::vector< int32_t >& y, double scale, double offset );
+    void set( const std::vector< int16_t >& y, double scale, double offset );
+
+    /** \brief add data points to end of plot data
+        @param[in] y the new data points
+        @param[in] count number of new data points
+
+        Summaries are extended, not rebuilt.  Plot is NOT refreshed.
+
+        An exception is thrown when this is called
+        for a trace that is not plot type,
+        or that shows data it does not own.
+    */
+    void extend( const double * y, long long count );
+
+    /** \brief plot data owned by the application, without copying
+        @param[in] y first data point
+        @param[in] count number of data points
+        @param[in] stride distance between successive data points, in values
+
+        Replaces any existing data.  Plot is NOT refreshed.
+        The data must remain valid until it is replaced, or the trace is destroyed.
+        Call changed() after the application modifies the data.
+
+        An exception is thrown when this is called
+        for a trace that is not plot type
+    */
+    void view( const double * y, long long count, int stride = 1 );
+
+    /** \brief plot data in shared buffer, without copying
+        @param[in] y buffer, the trace keeps a reference until the data is replaced
+        @param[in] count number of data points
+        @param[in] stride distance between successive data points, in values
+
+        As view( const double*, int, int ) but the trace shares ownership of the buffer.
+    */
+    void view( std::shared_ptr< const double > y, long long count, int stride = 1 );
+
+    /** \brief plot compact data owned by the application, without copying
+        @param[in] y first data point
+        @param[in] count number of data points
+        @param[in] stride distance between successive data points, in values
+        @param[in] scale multiplies stored value when drawn
+        @param[in] offset added to scaled value when drawn
+
+        As view( const double*, long long, int ) for other value types.
+    */
+    void view( const float * y, long long count, int stride = 1, double scale = 1, double offset = 0 );
+    void view( const int32_t * y, long long count, int stride = 1, double scale = 1, double offset = 0 );
+    void view( const int16_t * y, long long count, int stride = 1, double scale = 1, double offset = 0 );
+
+    /// layout of binary sample files
+    enum class eFile
+    {
+        float32,        ///< y values, 4 byte little-endian floats
+        float64,        ///< y values, 8 byte little-endian doubles
+        xy_float32,     ///< x,y pairs, 4 byte little-endian floats, x increasing
+        xy_float64,     ///< x,y pairs, 8 byte little-endian doubles, x increasing
+        int16,          ///< y values, 2 byte little-endian signed integers
+        int32           ///< y values, 4 byte little-endian signed integers
+    };
+
+    /** \brief plot data from binary file, without reading it
+        @param[in] path file holding the data
+        @param[in] format layout of the file
+        @param[in] scale multiplies y value read from file
+        @param[in] offset added to scaled y value
+
+        Replaces any existing data.  Plot is NOT refreshed.
+        The file is mapped into memory, pages are read only when touched.
+        The summaries used for bounds and drawing are built in one pass
+        on a worker thread, started when the plot is first drawn.
+        Until they are complete the plot shows coarse min and max bins
+        of the part of the file read so far, filling in from the left.
+        After that drawing reads only the pages under the pixel columns it needs.
+
+        An exception is thrown when this is called
+        for a trace that is not plot type,
+        or the file cannot be mapped.
+    */
+    void load( const std::string& path, eFile format, double scale = 1, double offset = 0 );
+
+    /** \brief notify trace that the application has modified viewed data
+        @param[in] first index of first data point changed
+        @param[in] last index after last data point changed
+
+        Bounds and summaries are updated for the changed range only.
+        Plot is NOT refreshed.
+    */
+    void changed( long long first, long long last );
+
+    /// notify trace that the application has modified all viewed data
+    void changed()
+    {
+        changed( 0, mySeries.size() );
+    }
+
+    /** \brief add new value to real time data, or sample to histogram
+        @param[in] y the new data point
+
+        An exception is thrown when this is called
+        for a trace that is not real time or histogram type.
+    */
+    void add( double y );
+
+    /** \brief add new values to real time data, or samples to histogram
+        @param[in] y the new data points, oldest first
+        @param[in] count number of new data points
+
+        The plot is refreshed once for the whole batch.
+
+        An exception is thrown when this is called
+        for a trace that is not real time or histogram type.
+    */
+    void add( const double * y, int count );
+
+    /** \brief let old histogram samples fade away
+        @param[in] halfLife number of samples after which a sample counts half, 0 for no decay
+
+        The bars show a live distribution of the recent samples.
+        Decay costs nothing per bin as samples arrive:
+        each new sample is given more weight than the one before instead.
+
+        An exception is thrown when this is called
+        for a trace that is not histogram type.
+    */
+    void decay( double halfLife );
+
+    /// histogram samples outside the range of fixed bins
+    long long outside() const
+    {
+        return myOutside;
+    }
+
+    /** \brief add row to waterfall
+        @param[in] values one value for each column
+
+        The row is colour mapped once, as it is added,
+        and shown at the top, older rows move down one row.
+
+        An exception is thrown when this is called
+        for a trace that is not waterfall type.
+    */
+    void addRow( const float * values );
+    void addRow( const double * values );
+
+    /** \brief add new value to real time data from any thread
+        @param[in] y the new data point
+        @return false if the sample was dropped because the queue is full
+
+        The value waits in a lock-free queue until the plot
+        drains all the queues on the GUI thread, once per frame.
+        Never blocks and never refreshes the plot directly.
+
+        Must only be called for a real time trace.
+        Traces in a realtime_group have no queue, post returns false.
+    */
+    bool post( double y )
+    {
+        return myQueue && myQueue->push( y );
+    }
+
+    /** \brief set size of queue used by post
+        @param[in] capacity number of samples that can wait for the next frame
+
+        Call from the GUI thread before any thread starts posting.
+        The default holds 16384 samples.
+
+        An exception is thrown when this is called
+        for a trace that is not real time type.
+    */
+    void queue( int capacity );
+
+    /** \brief keep a compressed history of the samples added
+        @param[in] samples number of most recent samples to keep, 0 for none
+
+        Zoom out or drag the view to the left of the display window
+        to see the history.  24 hours at 1 kHz is 86.4 million samples.
+        Samples rounded to a few decimal places, or integer ADC counts,
+        take 1.5 to 5 bits each, so a day needs 16 to 55 MB.
+        Full precision samples take about 50 bits each, around 540 MB a day,
+        so round samples to the precision they have before adding them.
+
+        An exception is thrown when this is called
+        for a trace that is not real time type.
+    */
+    void history( long long samples );
+
+    /** \brief keep a compressed history, spilling to a file
+        @param[in] samples number of most recent samples to keep
+        @param[in] path spill file
+        @param[in] memory bytes of compressed history to keep in memory
+
+        Compressed blocks of samples are appended to the file as they fill,
+        older blocks are read back from the file when the view needs them.
+        If the file holds blocks from an earlier run, perhaps one that crashed,
+        they are recovered and shown before the new samples.
+    */
+    void history( long long samples, const std::string& path, long long memory = 16 << 20 );
+
+    /// bytes used by compressed history
+    long long historyBytes() const
+    {
+        return myHistory ? myHistory->bytes() : 0;
+    }
+
+    /// number of samples in history
+    long long historyCount() const
+    {
+        return myHistory ? myHistory->total() - myHistory->first() : 0;
+    }
+
+    /** \brief copy samples from history, for export
+        @param[in] first of samples to copy, 0 for the oldest in history
+        @param[in] count number of samples to copy
+        @return samples, fewer than count if history ends first
+
+        Only the blocks holding the samples are decoded.
+    */
+    std::vector< double > historyExport( long long first, long long count ) const;
+
+    /** \brief number of samples dropped
+
+        For a realtime trace, the posted samples dropped because the queue was full.
+        For a spectrum trace, the source samples dropped because the FFT did not keep up.
+    */
+    long long dropped() const
+    {
+        if( mySpectrum )
+            return mySpectrum->dropped();
+        return myQueue ? myQueue->dropped() : 0;
+    }
+
+    /** \brief add point to scatter trace, or timestamped sample to timed trace
+        @param[in] x location, or time of sample
+        @param[in] y location, or value of sample
+
+        For a timed trace the times must not decrease,
+        samples older than the trace duration before the newest are discarded.
 
-        Replaces any existing data.  Plot is NOT refreshed.
         An exception is thrown when this is called
-        for a trace that is not plot type
+        for a trace that is not scatter or timed type
     */
-    void set( const std::vector< double >& y );
 
-    /** \brief add new value to real time data
-        @param[in] y the new data point
+    void add( double x, double y );
+
+    /** \brief add points to scatter trace
+        @param[in] x locations
+        @param[in] y locations
+        @param[in] count number of points
 
         An exception is thrown when this is called
-        for a trace that is not real time type.
+        for a trace that is not scatter type
     */
-    void add( double y );
+    void add( const double * x, const double * y, int count );
+
+    /** \brief set when scatter trace is drawn as a density heatmap
+        @param[in] threshold number of points above which the heatmap is drawn
+
+        Instead of a box around every point
+        the points are counted in each pixel, across several threads,
+        and each pixel with points is coloured by its count
+        from dark blue ( few ) to yellow ( many ).
+
+        The default threshold is 100,000 points. 0 draws every scatter as a heatmap.
+    */
+    void density( long long threshold );
 
-    /** \brief add point to scatter trace
+    /** \brief find scatter point nearest to a location
         @param[in] x location
         @param[in] y location
+        @param[in] radius pixels from location to search
+        @return index of point, or -1 if there is no point within radius
 
-        An exception is thrown when this is called
-        for a trace that is not scatter type
+        Distance is measured between the pixels where the location and the points are drawn.
+        The first call builds a spatial index
+        which is then kept up to date as points are added.
     */
+    long long nearest( double x, double y, int radius );
 
-    void add( double x, double y );
+    /** \brief find scatter points inside a rectangle
+        @param[out] hits indices of points
+    */
+    void inside( double xmin, double xmax, double ymin, double ymax,
+                 std::vector< long long >& hits );
 
-    /// set color
-    void color( const colors & clr )
+    /// x location of scatter point
+    double x( long long i ) const
+    {
+        return myX[ i ];
+    }
+
+    /// y location of scatter point
+    double y( long long i ) const
+    {
+        return myY[ i ];
+    }
+
+    /// indices of scatter points in the last rubber band selection
+    const std::vector< long long >& selected() const
     {
-        myColor = clr;
+        return mySelected;
     }
 
-    int size()
+    /// set color
+    void color( const colors & clr );
+
+    long long size()
     {
-        return (int) myY.size();
+        if( myType == eType::plot )
+            return mySeries.size();
+        if( myType == eType::realtime )
+            return myRing->width();
+        if( myType == eType::timed )
+            return myY.size() - myTimedFirst;
+        if( myType == eType::histogram )
+            return myBin.size();
+        if( myType == eType::waterfall )
+            return myRows;
+        if( myType == eType::spectrum )
+            return mySpectrum->spectrum().size();
+        return myY.size();
     }
 
 private:
 
     friend plot;
+    friend realtime_group;
 
     plot * myPlot;
     std::vector< double > myX;
     std::vector< double > myY;
+    series mySeries;                    ///< plot data, in myY or owned by application
+    series myXSeries;                   ///< plot x values, empty when x is the sample index
+    std::shared_ptr< mapped_file > myFile;      ///< file holding plot data
+    bool myfSummarized;                 ///< true if myPyramid is up to date
+    std::vector< point > myLine;        ///< pixel co-ordinates of the line to draw
+    std::vector< double > myXBuf;       ///< values waiting for pixel transform
+    std::vector< double > myYBuf;
+    std::vector< int > myXPx;           ///< pixels from transform
+    std::vector< int > myYPx;
+    pyramid myPyramid;                  ///< min/max summaries of plot data
+    std::unique_ptr< summary_worker > mySummary;    ///< builds myPyramid of a mapped file
+    std::vector< summary_worker::bin > myCoarse;    ///< drawn until mySummary is done
+    sliding_bounds myWindowBounds;      ///< min/max of realtime data
+    double myXMin, myXMax;              ///< bounds of scatter data
+    double myYMin, myYMax;
+    long long myDensityThreshold;       ///< scatter points above which a heatmap is drawn
+    point_index myIndex;                ///< spatial index of scatter points
+    bool myfIndex;                      ///< true if myIndex is in use
+    std::vector< long long > mySelected;        ///< scatter points selected by mouse
+    std::unique_ptr< ingest_queue > myQueue;    ///< samples posted to realtime trace
     colors myColor;
-    int myRealTimeNext;
+    std::shared_ptr< ring > myRing;     ///< realtime samples, maybe shared with other traces
+    int myChannel;                      ///< channel of myRing holding this trace
+    std::unique_ptr< history_store > myHistory; ///< every sample since history() was called, compressed
+    long long myHistoryOrigin;          ///< ring frame number of first history sample
+    double myDuration;                  ///< time window of timed trace
+    size_t myTimedFirst;                ///< oldest sample of timed trace in myX, myY
+    long long myTimedDropped;           ///< samples of timed trace discarded since start
+    std::vector< double > myBin;        ///< weighted sample count in each histogram bin
+    double myBinMin;                    ///< left edge of first histogram bin
+    double myBinWidth;
+    bool myfExpand;                     ///< true if bins grow to cover every sample
+    double myWeight;                    ///< weight of next histogram sample
+    double myDecay;                     ///< weight of a sample relative to the next, 1 for no decay
+    long long myOutside;                ///< samples outside fixed bins
+    int myColumns;                      ///< values in each waterfall row
+    int myRows;                         ///< waterfall rows shown
+    int myRowNext;                      ///< waterfall row to be replaced by the next row added
+    long long myRowTotal;               ///< waterfall rows ever added
+    double myCellMin, myCellMax;        ///< values mapped to the ends of the colour ramp
+    std::vector< float > myCells;       ///< ring of waterfall rows, row after row
+    std::vector< unsigned > myImage;    ///< colour of each waterfall cell, as myCells
+    std::shared_ptr< spectrum_worker > mySpectrum;      ///< computes spectrum shown by this trace
+    double myBinScale;                  ///< x distance between spectrum bins
+    std::vector< std::shared_ptr< spectrum_worker > > mySpectra;    ///< spectra of this trace's samples
     enum class eType
     {
         plot,
         realtime,
-        scatter
+        scatter,
+        timed,
+        histogram,
+        waterfall,
+        spectrum
     } myType;
 
     /** CTOR
@@ -105,7 +1343,11 @@ private:
 
     */
     trace()
-        : myType( eType::plot )
+        : myfSummarized( true )
+        , myDensityThreshold( 100000 )
+        , myfIndex( false )
+        , myOutside( 0 )
+        , myType( eType::plot )
     {
 
     }
@@ -122,11 +1364,66 @@ private:
     Data points older than w scroll off the left edge of the plot and are lost
     */
     void realTime( int w )
+    {
+        realTime( std::make_shared< ring >( 1, w ), 0 );
+        myQueue.reset( new ingest_queue( 16384 ) );
+    }
+
+    /** \brief Convert trace to real time operation, on a channel of a shared ring
+    @param[in] r the ring
+    @param[in] channel the channel of the ring holding this trace's samples
+    */
+    void realTime( const std::shared_ptr< ring >& r, int channel )
     {
         myType = eType::realtime;
-        myRealTimeNext = 0;
+        myRing = r;
+        myChannel = channel;
+
+        // the window starts full of zeros
+        myWindowBounds.clear( r->width() );
+        myWindowBounds.push( 0 );
+    }
+
+    /** \brief Convert trace to real time operation with timestamped samples
+    @param[in] duration time window to display
+
+    Samples older than duration before the newest are discarded
+    */
+    void timed( double duration )
+    {
+        myType = eType::timed;
+        myDuration = duration;
+        myTimedFirst = 0;
+        myTimedDropped = 0;
+        myX.clear();
         myY.clear();
-        myY.resize( w );
+        myWindowBounds.clear( std::numeric_limits< int >::max() );
+    }
+
+    /** \brief Convert trace to histogram
+    @param[in] min left edge of bins
+    @param[in] max right edge of bins
+    @param[in] bins number of bins
+    @param[in] expand true if the bins double in width to cover samples outside them
+    */
+    void histogram( double min, double max, int bins, bool expand );
+
+    /** \brief Convert trace to waterfall
+    @param[in] columns values in each row
+    @param[in] rows number of rows shown
+    @param[in] min value shown in the colour at the bottom of the ramp
+    @param[in] max value shown in the colour at the top of the ramp
+    */
+    void waterfall( int columns, int rows, double min, double max );
+
+    /// true for traces that change every frame and are not kept in the static layer
+    bool live() const
+    {
+        return myType == eType::realtime
+               || myType == eType::timed
+               || myType == eType::histogram
+               || myType == eType::waterfall
+               || myType == eType::spectrum;
     }
 
     /** \brief Convert trace to point operation for scatter plots */
@@ -137,15 +1434,231 @@ private:
         myX.clear();
     }
 
-    /// min and max values in trace
-    void bounds(
+    /** \brief min and max values in trace
+        @return false if the trace has no data, the bounds are not set
+
+        The bounds are kept up to date as data is added,
+        so this does not scan the data.
+    */
+    bool bounds(
         double& txmin, double& txmax,
         double& tymin, double& tymax );
 
     /// draw
-    void update( paint::graphics& graph );
+    void update( rasterizer& graph );
+
+    /// update window bounds with the newest count samples in myRing
+    void pushBounds( int count );
+
+    /** \brief draw realtime history left of the display window
+        @param[in] graph where to draw
+        @param[in] left first pixel column that is shown
+
+        Sample total - w, the oldest in the ring, is drawn at x = 0,
+        older samples at negative x.
+    */
+    void drawHistory( rasterizer& graph, int left );
+
+    /// add timestamped sample to timed trace without refreshing
+    void appendTimed( double t, double y );
+
+    /// count samples in histogram bins without refreshing
+    void appendHistogram( const double * y, int count );
+
+    /// double width of histogram bins so that y falls in one of them
+    void expandBins( double y );
+
+    /// draw histogram bars
+    void bars( rasterizer& graph );
+
+    /// pass new realtime samples to history and spectra
+    void feed( const double * y, int count, int stride );
+
+    /// colour map the waterfall row just added to myCells
+    void mapRow();
+
+    /// copy waterfall cells under each pixel from myImage
+    void image( rasterizer& graph );
+
+    /// add new value to real time data without refreshing
+    void append( double y );
+
+    /// add new values to real time data without refreshing
+    void append( const double * y, int count );
+
+    /** \brief move posted samples into the real time data
+        @return true if any samples were moved
+    */
+    bool drain();
+
+    /// draw scatter points as a heatmap of points per pixel
+    void heatmap( rasterizer& graph );
+
+    /** \brief count scatter points in each pixel
+        @param[out] count points per pixel, row by row, w by h
+        @param[in] w width in pixels
+        @param[in] h height in pixels
+        @param[in] first index of first point to count
+        @param[in] last index after last point to count
+
+        Called concurrently on separate parts of the data,
+        so reads nothing but the points and the plot scale.
+    */
+    void bin( std::vector< unsigned >& count, int w, int h,
+              long long first, long long last ) const;
+
+    /** \brief find scatter point drawn nearest to a pixel
+        @param[in] p pixel
+        @param[in] radius pixels from p to search
+        @param[out] d2 squared distance in pixels to the point found
+        @return index of point, or -1 if no point is drawn within radius
+
+        Candidates from the spatial index are transformed in batches
+        by the same pixel kernel that draws them.
+    */
+    long long nearest( const point& p, int radius, long long& d2 );
+
+    /** \brief transform myXBuf and myYBuf to pixels in myXPx and myYPx
+
+    The buffers are cleared, ready for the next batch
+    */
+    void pixels();
+
+    /// draw line through the points in myLine
+    void polyline( rasterizer& graph );
+
+    /** \brief draw realtime samples in scroll co-ordinates
+        @param[in] graph where to draw
+        @param[in] first number of samples added before the first sample to draw
+        @param[in] last number of samples added before the sample after the last to draw
+        @param[in] xlast pixel column of the most recent sample
+
+        Sample number a is drawn at xlast - ( floor( s * ( total - 1 ) ) - floor( s * a ) )
+        where s is the x scale, so when n more samples arrive
+        every sample moves left by the same whole number of pixels.
+    */
+    void scrollUpdate( rasterizer& graph, long long first, long long last, int xlast );
+
+    /// pixel column offset of sample number a, in scroll co-ordinates
+    int scrollPixel( long long a ) const;
+
+    /// index of first sample drawn at or right of pixel column px
+    long long firstSampleAt( int px );
+
+    /// x value of static trace sample
+    double X( long long i ) const
+    {
+        return myXSeries.size() ? myXSeries[ i ] : i;
+    }
+
+    /// replace static data with view, summaries are built when first needed
+    void replace( const series& y, const series& x );
+
+    /// replace static data with a copy of y, stored as T
+    template< class T >
+    void own(
+        const std::vector< T >& y,
+        series::eValue value,
+        double scale, double offset );
+
+    /// replace static data with view of y, stored as T
+    template< class T >
+    void viewAs(
+        const T * y,
+        series::eValue value,
+        long long count, int stride,
+        double scale, double offset );
+
+    /** \brief build summaries of static data if needed
+
+        The summaries of a mapped file are built on a worker thread,
+        myfSummarized is set when drain takes them.
+    */
+    void summarize();
+};
+/** \brief Realtime traces that share one timebase
+
+    Every trace in the group receives one sample per frame,
+    so the traces of a multi-channel instrument stay aligned.
+    The samples of all traces live in one ring buffer
+    with a contiguous block per trace and a common head index.
+
+    <pre>
+        // 32 channels, 500 samples displayed for each
+        auto& channels = thePlot.AddRealTimeGroup( 500, 32 );
+        channels[ 0 ].color( colors::red );
+
+        // when a frame arrives
+        double frame[ 32 ];
+        ...
+        channels.add( frame );
+    </pre>
+*/
+class realtime_group
+{
+public:
+
+    /// number of traces in the group
+    int channels() const
+    {
+        return (int)myTrace.size();
+    }
+
+    /// trace of channel c, for setting its color
+    trace& operator[]( int c )
+    {
+        return *myTrace[ c ];
+    }
+
+    /** \brief add one sample to every trace
+        @param[in] frame sample for each trace, in channel order
+    */
+    void add( const double * frame )
+    {
+        add( frame, 1 );
+    }
+
+    /** \brief add several frames
+        @param[in] frames sample for channel c of frame f at frames[ f * channels() + c ]
+        @param[in] count number of frames, oldest first
+
+        The plot is refreshed once for the whole batch.
+    */
+    void add( const double * frames, int count );
+
+    /// keep a compressed history of every trace in the group, see trace::history
+    void history( long long samples )
+    {
+        for( auto t : myTrace )
+            t->history( samples );
+    }
+
+    /** \brief keep a compressed history of every trace in the group, spilling to files
+        @param[in] samples number of most recent samples to keep
+        @param[in] path spill file of channel c is path.c
+        @param[in] memory bytes of compressed history of each channel to keep in memory
+    */
+    void history( long long samples, const std::string& path, long long memory = 16 << 20 )
+    {
+        for( int c = 0; c < (int)myTrace.size(); c++ )
+            myTrace[ c ]->history( samples, path + "." + std::to_string( c ), memory );
+    }
+
+private:
+    friend plot;
+
+    plot * myPlot;
+    std::shared_ptr< ring > myRing;
+    std::vector< trace* > myTrace;
 };
+
 /** \brief Draw decorated vertical line on LHS of plot for Y-axis
+    or horizontal line along the bottom for X-axis
+
+    Tick marks are placed at "nice" values, 1, 2 or 5 times a power of ten,
+    and labelled by text drawn straight onto the plot graphics.
+    The ticks, their labels and the label sizes are recalculated
+    only when the axis range changes.
 
     This class is internal and none of its methods should be
     called by the application code
@@ -165,11 +1678,22 @@ public:
 
 private:
     plot * myPlot;
-    label myLabelMin;
-    label myLabelMax;
-    label myLabelZero;
     bool myfGrid;
     bool myfX;              // true for x-axis
+
+    double myTickMin, myTickMax;        ///< range ticks were calculated for
+    int myTickCount;                    ///< number of ticks asked for
+    std::vector< double > myTick;       ///< tick values
+    std::vector< std::string > myText;  ///< tick labels
+    std::vector< nana::size > myExtent; ///< size of tick labels, in pixels
+
+    /** \brief calculate tick values and labels, if range has changed
+        @param[in] graph where labels will be drawn, for text size
+        @param[in] mn start of range
+        @param[in] mx end of range
+        @param[in] count approximate number of ticks wanted
+    */
+    void ticks( paint::graphics& graph, double mn, double mx, int count );
 };
 
 
@@ -177,14 +1701,19 @@ private:
 
 The plot contains one or more traces.
 
-Each trace can be of one of three types:
+Each trace can be of one of seven types:
 
 - Plot: succesive y-values with line drawn between them.
 - Scatter: succesive x,y-values with box around each point
 - Realtime: a specified number of the most recent y-values
+- Timed: the y-values received in a recent time window, placed by their timestamps
+- Histogram: bars counting the samples received in each bin
+- Waterfall: the most recent rows of values, such as spectra, as a colour mapped image
+- Spectrum: the spectrum of the recent samples of a realtime trace
 
-Any number of plot and scatter traces can be shown together,
-only one realtime trace may be present in a plot.
+Any number of plot, scatter and realtime traces can be shown together.
+Realtime traces that receive samples together can share one timebase
+by adding them with AddRealTimeGroup.
 
  */
 class plot
@@ -200,6 +1729,21 @@ public:
     {
         delete myAxis;
         delete myAxisX;
+        for( auto g : myGroup )
+            delete g;
+
+        // the parent window may outlive the plot
+        for( auto h : myEvents )
+            API::umake_event( h );
+        drawing( myParent ).erase( myDrawer );
+
+        // stop spectrum and summary worker threads
+        for( auto t : myTrace )
+        {
+            t->mySpectra.clear();
+            t->mySpectrum.reset();
+            t->mySummary.reset();
+        }
     }
 
     /** \brief Add static trace
@@ -215,6 +1759,7 @@ public:
         trace * t = new trace();
         t->Plot( this );
         myTrace.push_back( t );
+        LayersChanged();
         return *t;
     }
 
@@ -232,9 +1777,78 @@ public:
         t->Plot( this );
         t->realTime( w );
         myTrace.push_back( t );
+        StartFrameTimer();
         return *t;
     }
 
+    /** \brief Add realtime traces that share one timebase
+        @param[in] w number of recent data points to display in each trace
+        @param[in] channels number of traces
+        @return reference to the group, which adds samples to all its traces at once
+    */
+    realtime_group& AddRealTimeGroup( int w, int channels );
+
+    /** \brief Add real time trace with timestamped samples
+        @param[in] duration time window to display, in the units of the timestamps
+        @return reference to new trace
+
+        Samples are added by trace::add( t, y ) as they arrive, at any rate.
+        The x-axis shows time, from duration before the newest sample to the newest.
+        Older samples are discarded, so memory depends on the duration
+        and the sample rate, not on the time the trace has been running.
+    */
+    trace& AddTimedTrace( double duration );
+
+    /** \brief Add histogram trace
+        @param[in] min left edge of bins
+        @param[in] max right edge of bins
+        @param[in] bins number of bins
+        @param[in] expand true to widen the bins for samples outside them
+        @return reference to new trace
+
+        Samples are added by trace::add( y ) or trace::add( y, count )
+        and counted in their bin as they arrive, the samples are not kept.
+        Drawing reads only the bin counts,
+        so costs the same however many samples have been seen.
+
+        With fixed bins samples outside them are counted by trace::outside.
+        Expanding bins double in width, merging neighbours,
+        until every sample falls in a bin, so the number of bins never changes.
+    */
+    trace& AddHistogramTrace( double min, double max, int bins, bool expand = false );
+
+    /** \brief Add waterfall trace
+        @param[in] columns values in each row
+        @param[in] rows number of recent rows to display
+        @param[in] min value shown dark blue
+        @param[in] max value shown yellow
+        @return reference to new trace
+
+        Rows are added by trace::addRow, for example a spectrum at a time.
+        The newest row is at the top, x runs from 0 to columns
+        and y from 0 at the oldest row to rows at the top of the newest.
+
+        Each row is colour mapped once, as it arrives,
+        into a ring of rows that scrolls by moving its first row,
+        so a frame copies the mapped cells and maps nothing.
+    */
+    trace& AddWaterfallTrace( int columns, int rows, double min, double max );
+
+    /** \brief Add spectrum trace
+        @param[in] source realtime trace whose samples are analysed
+        @param[in] size samples in each FFT frame, a power of 2
+        @param[in] hop samples between the starts of successive frames, 0 for size / 2
+        @param[in] rate samples per second of the source, so x is in Hz, 0 to show x in bins
+        @return reference to new trace
+
+        A worker thread takes overlapping frames of the source samples as they are added,
+        windows them and computes their FFT.
+        The trace shows the magnitude of the newest spectrum in dB.
+        Each result is published with its min and max,
+        so drawing neither copies the spectrum nor scans it for bounds.
+    */
+    trace& AddSpectrumTrace( trace& source, int size, int hop = 0, double rate = 0 );
+
     /** \brief Add scatter trace
         @return reference to new trace
 
@@ -249,6 +1863,7 @@ public:
     void Grid( bool enable )
     {
         myAxis->Grid( enable );
+        LayersChanged();
     }
 
     int X2Pixel( double x ) const
@@ -259,6 +1874,32 @@ public:
     {
         return myYOffset - myYScale * y;
     }
+    /** \brief Convert many x values to pixel columns
+        @param[in] x values
+        @param[out] px pixel columns, same result as X2Pixel( x[k] )
+        @param[in] count number of values
+
+        Uses AVX2 or SSE2 when the CPU has them
+    */
+    void X2Pixel( const double* x, int* px, int count ) const;
+
+    /** \brief Convert many y values to pixel rows
+        @param[in] y values
+        @param[out] px pixel rows, same result as Y2Pixel( y[k] )
+        @param[in] count number of values
+    */
+    void Y2Pixel( const double* y, int* px, int count ) const;
+
+    /// x value drawn at pixel column px, the inverse of X2Pixel
+    double Pixel2X( int px ) const
+    {
+        return ( px - myXOffset ) / myXScale;
+    }
+    /// y value drawn at pixel row py, the inverse of Y2Pixel
+    double Pixel2Y( int py ) const
+    {
+        return ( myYOffset - py ) / myYScale;
+    }
 
     float xinc()
     {
@@ -280,11 +1921,11 @@ public:
     {
         return myMaxY;
     }
-    int XOffset()
+    double XOffset()
     {
         return myXOffset;
     }
-    int YOffset()
+    double YOffset()
     {
         return myYOffset;
     }
@@ -293,11 +1934,89 @@ public:
         return myParent;
     }
 
-    void update()
+    /** \brief request a repaint
+
+        The plot is marked as needing a repaint.
+        The frame timer repaints at most once per frame,
+        however many traces ask for a repaint in between.
+        In on demand mode nothing is repainted until Refresh is called,
+        except in response to the mouse.
+    */
+    void update();
+
+    /** \brief fix y range and scroll a realtime trace incrementally
+        @param[in] ymin bottom of y axis
+        @param[in] ymax top of y axis
+
+        With the scale fixed, each frame shifts the previous image left
+        and draws only the samples that arrived since the last frame.
+        Drawing and pixel reads depend on the new data,
+        the shift and the copy to the window are two native copies of the image.
+
+        Applies when the plot holds only realtime traces sharing one timebase,
+        a single realtime trace or one realtime_group,
+        otherwise the plot is redrawn as usual, within the fixed y range.
+    */
+    void RealTimeScroll( double ymin, double ymax );
+
+    /** \brief set maximum repaint rate
+        @param[in] fps frames per second, or 0 for on demand
+
+        The default is 60 frames per second.
+        With 0 the plot is repainted, and samples posted to realtime traces
+        are drained, only when the application calls Refresh.
+        Zooming, dragging, hovering and selecting with the mouse still repaint at once,
+        without draining.
+    */
+    void FrameRate( int fps );
+
+    /// drain posted samples and repaint now
+    void Refresh();
+
+    /** \brief show part of the plot
+        @param[in] xmin left edge
+        @param[in] xmax right edge
+        @param[in] ymin bottom edge
+        @param[in] ymax top edge
+
+        Samples outside the view are not read,
+        so a view into a huge static trace costs no more than a small trace.
+
+        The user can also zoom with the mouse wheel
+        and drag the view with the right mouse button.
+    */
+    void SetView( double xmin, double xmax, double ymin, double ymax );
+
+    /// show all the data, undoing SetView, zoom and drag
+    void FitView();
+
+    /** \brief register function called when the user selects scatter points
+        @param[in] f function to call
+
+        Dragging with the left mouse button draws a rubber band rectangle.
+        On release the scatter points inside are stored in trace::selected
+        of each scatter trace, then f is called.
+
+        Hovering near a scatter point always shows its location.
+    */
+    void OnSelect( std::function< void() > f )
+    {
+        mySelectHandler = f;
+    }
+
+    /// number of repaint requests merged into an earlier pending repaint
+    long long Coalesced() const
     {
-        API::refresh_window( myParent );
+        return myCoalesced;
     }
 
+    /** \brief move samples posted to real time traces into the traces
+        @return true if any samples were moved
+
+        Called by the frame timer on the GUI thread once per frame.
+    */
+    bool Drain();
+
     void debug()
     {
         for( auto t : myTrace )
@@ -308,21 +2027,75 @@ public:
 
 private:
 
+    friend trace;
+
     ///window where plot will be drawn
     window myParent;
 
+    /** \brief axes, static and scatter traces, as last drawn
+
+        Rebuilt only when one of them, or the scale, changes.
+        Each frame copies this layer and draws the realtime traces on top.
+    */
+    paint::graphics myStaticLayer;
+    bool myfStaticLayer;                ///< true if myStaticLayer is up to date
+    double myLayerXScale, myLayerYScale;        ///< scale myStaticLayer was drawn with
+    double myLayerXOffset, myLayerYOffset;
+
+    bool myfFixedY;                     ///< true if y range fixed by RealTimeScroll
+    double myFixedMinY, myFixedMaxY;
+
+    /** \brief realtime trace as last drawn, on background, for incremental scrolling
+
+        When new samples arrive the image is shifted left
+        and only the new samples are drawn.
+    */
+    paint::graphics myScrollLayer;
+    paint::graphics myScrollSpare;      ///< receives myScrollLayer shifted, then swapped with it
+    paint::graphics myScrollBackground; ///< window background, to fill exposed areas
+    bool myfScrollLayer;                ///< true if myScrollLayer is up to date
+    long long myScrollTotal;            ///< realtime samples drawn into myScrollLayer
+    double myScrollXScale, myScrollYScale;      ///< scale myScrollLayer was drawn with
+    double myScrollXOffset, myScrollYOffset;
+
+    /// drains samples posted to real time traces and repaints when needed
+    timer myFrameTimer;
+    int myFrameRate;                    ///< frames per second, 0 for on demand
+    bool myfFrameTimer;                 ///< true if frame timer running
+    bool myfDirty;                      ///< true if repaint requested since last paint
+    long long myCoalesced;
+
+    trace * myHoverTrace;               ///< scatter trace with point under mouse, or null
+    long long myHoverIndex;             ///< point under mouse
+    bool myfSelecting;                  ///< true while rubber band is dragged
+    point mySelectStart, mySelectEnd;   ///< corners of rubber band
+    std::function< void() > mySelectHandler;
+    std::vector< event_handle > myEvents;       ///< mouse handlers, removed by the destructor
+    drawing::diehard_t myDrawer;                ///< paint handler, erased by the destructor
+
+    bool myfView;                       ///< true if view set, by SetView or mouse
+    double myViewMinX, myViewMaxX;
+    double myViewMinY, myViewMaxY;
+    bool myfPanning;                    ///< true while view is dragged
+    point myPanStart;                   ///< mouse location where drag started
+    double myPanMinX, myPanMaxX;        ///< view when drag started
+    double myPanMinY, myPanMaxY;
+
     axis * myAxis;
     axis * myAxisX;
 
     /// plot traces
     std::vector< trace* > myTrace;
 
+    /// groups of realtime traces sharing a timebase
+    std::vector< realtime_group* > myGroup;
+
     float myXinc;
     double myMinX, myMaxX;
     double myMinY, myMaxY;
     double myXScale, myYScale;
-    int myXOffset;
-    int myYOffset;
+    double myXOffset;
+    double myYOffset;
 
     /** calculate scaling factors so plot will fit in window client area
         @param[in] w width
@@ -333,9 +2106,155 @@ private:
     /// arrange for the plot to be updated when needed
     void RegisterDrawingFunction();
 
+    /// arrange for hover readout and rubber band selection
+    void RegisterMouseFunctions();
+
+    /** \brief zoom view about a point
+        @param[in] p pixel that stays put
+        @param[in] f factor to multiply view size, < 1 zooms in
+    */
+    void Zoom( const point& p, double f );
+
+    /** \brief range shown, the view or the data range as CalcScale shows it
+
+        A flat data range is widened as CalcScale widens it,
+        so the range is never empty.
+    */
+    void ShownView( double& xmin, double& xmax, double& ymin, double& ymax ) const;
+
+    /** \brief repaint after the user acts on the plot
+
+        Through the frame timer, or at once in on demand mode,
+        where there is no frame timer and the application may never call Refresh.
+    */
+    void Repaint();
+
+    /// find scatter point under mouse, return true if it changed
+    bool Hover( const point& p );
+
+    /// store scatter points inside rubber band in their traces
+    void Select();
+
+    /// draw hover readout and rubber band on top of the plot
+    void DrawOverlay( paint::graphics& graph );
+
+    /// rebuild static and scroll layers at the next paint
+    void LayersChanged()
+    {
+        myfStaticLayer = false;
+        myfScrollLayer = false;
+    }
+
+    /** \brief draw realtime trace by scrolling previous image, if possible
+        @param[in] graph window graphics, holding the background
+        @return false if the plot must be drawn as usual
+    */
+    bool DrawScroll( paint::graphics& graph );
+
+    /** \brief draw everything except realtime traces into the static layer, if needed
+        @param[in] graph window graphics, holding the background
+    */
+    void DrawStaticLayer( paint::graphics& graph );
+
+    /// start frame timer, unless on demand or already running
+    void StartFrameTimer();
+
+    /// once per frame: drain posted samples, repaint if needed
+    void Frame();
+
     int MaxXPixel();
 
 };
 
+/** \brief Load CSV or TSV file into static traces, on a worker thread
+
+    Each column of the file becomes a static trace.
+    The worker thread parses the file in chunks
+    and the GUI thread adds each chunk to the traces as it arrives,
+    so the plot shows the data loaded so far while the load continues.
+
+    A first line that does not start with a number is taken as a header and skipped.
+    A missing or unreadable value repeats the previous value of its column.
+
+    <pre>
+        plot::plot thePlot( fm );
+        plot::csv_loader loader( thePlot, "capture.csv" );
+        ...
+        std::cout << loader.progress() << "\n";
+    </pre>
+
+    The loader must outlive the load, its destructor abandons a load in progress.
+*/
+class csv_loader
+{
+public:
+
+    /** \brief CTOR, starts the load
+        @param[in] thePlot plot where traces will be added
+        @param[in] path file to load
+        @param[in] delimiter field separator, ',' for CSV or '\\t' for TSV
+
+        An exception is thrown if the file cannot be opened
+    */
+    csv_loader(
+        plot& thePlot,
+        const std::string& path,
+        char delimiter = ',' );
+
+    ~csv_loader();
+
+    /// fraction of the file parsed, 0 to 1
+    double progress() const
+    {
+        return mySize ? (double) myParsed.load() / mySize : 1;
+    }
+
+    /// true when every value has been added to the traces
+    bool done() const
+    {
+        return myfDone;
+    }
+
+    /// number of columns found, 0 until the first line has been parsed
+    int columns() const
+    {
+        return myTrace.size();
+    }
+
+    /// trace showing a column
+    trace& column( int k )
+    {
+        return *myTrace[ k ];
+    }
+
+private:
+    plot& myPlot;
+    FILE * myFile;
+    char myDelimiter;
+    long long mySize;                           ///< bytes in file
+    std::atomic< long long > myParsed;          ///< bytes parsed so far
+    std::atomic< bool > myfStop;                ///< true to abandon load
+    std::atomic< bool > myfParsed;              ///< true when worker has finished
+    bool myfDone;
+    std::vector< trace* > myTrace;
+
+    /// values parsed but not yet added to traces, one vector per column
+    std::vector< std::vector< double > > myPending;
+    std::mutex myMutex;
+
+    timer myTimer;
+    std::thread myThread;
+
+    /// parse file, runs on worker thread
+    void parse();
+
+    /// add parsed values to traces, runs on GUI thread
+    void poll();
+
+    csv_loader( const csv_loader& );
+    csv_loader& operator=( const csv_loader& );
+};
+
+
 }
 }